@@ -2,23 +2,201 @@
 #include <zlib.h>
 
 #include "NBT_Value.h"
+#include "NBT_Events.h"
+#include "NBT_Document.h"
+#include "SpongeSchematic.h"
+#include "PackedBlockStorage.h"
+#include "BlockRegion.h"
 #include <fstream>
+#include <chrono>
 
 using namespace NBT;
 using namespace std;
 
+// 读入性能测试：重复载入同一文件，输出平均每次耗时
+static void bench_load(const char* path, int state, int rounds) {
+	auto start = chrono::steady_clock::now();
+	for (auto i = 0; i < rounds; i++) {
+		//读入文件，注意必须要使用二进制格式打开文件
+		NBT_Value nbt{};
+		ifstream fin(path, ios::binary);
+		fin >> nbt.set_state(state);
+	}
+	auto end = chrono::steady_clock::now();
+
+	cout << "load " << path << ": "
+		<< chrono::duration<double, micro>(end - start).count() / rounds << " us" << endl;
+}
+
+static void bench_map_load(const char* path, int state, int rounds) {
+	auto start = chrono::steady_clock::now();
+	for (auto i = 0; i < rounds; i++) {
+		NBT_Value nbt{};
+		nbt.set_state(state).load(path);
+	}
+	auto end = chrono::steady_clock::now();
+
+	cout << "map load " << path << ": "
+		<< chrono::duration<double, micro>(end - start).count() / rounds << " us" << endl;
+}
+
+// 内存池读入性能测试：同一个文档反复载入，内存池在每次载入前整体释放
+static void bench_document_load(const char* path, int state, int rounds) {
+	NBT_Document doc;
+	doc.set_state(state);
+	auto start = chrono::steady_clock::now();
+	for (auto i = 0; i < rounds; i++)
+		doc.load(path);
+	auto end = chrono::steady_clock::now();
+
+	cout << "document load " << path << ": "
+		<< chrono::duration<double, micro>(end - start).count() / rounds << " us" << endl;
+}
+
+// 事件解析性能测试：只统计调色板条目数，不构建NBT_Value树
+struct palette_counter :public NBT_Handler {
+	int depth = 0;
+	int palette_depth = -1;
+	int entries = 0;
+
+	bool begin_compound(std::string_view name) {
+		if (name == "Palette")
+			palette_depth = depth;
+		depth++;
+		return true;
+	}
+	void end_compound() {
+		if (--depth == palette_depth)
+			palette_depth = -1;
+	}
+	template<typename T>
+	void scalar(tag, std::string_view, T) {
+		if (palette_depth >= 0 && depth == palette_depth + 1)
+			entries++;
+	}
+};
+
+static void bench_events(const char* path, int state, int rounds) {
+	int entries = 0;
+	auto start = chrono::steady_clock::now();
+	for (auto i = 0; i < rounds; i++) {
+		palette_counter counter;
+		parse_events(std::filesystem::path(path), counter, state);
+		entries = counter.entries;
+	}
+	auto end = chrono::steady_clock::now();
+
+	cout << "events " << path << ": " << entries << " palette entries, "
+		<< chrono::duration<double, micro>(end - start).count() / rounds << " us" << endl;
+}
+
+// 写出性能测试：只计编码，不计文件写入
+static void bench_save(const char* path, int state, int rounds) {
+	NBT_Value nbt{};
+	nbt.set_state(state).load(path);
+	size_t total = 0;
+	auto start = chrono::steady_clock::now();
+	for (auto i = 0; i < rounds; i++)
+		total += nbt.to_binary().size();
+	auto end = chrono::steady_clock::now();
+
+	cout << "save " << path << " (" << total / rounds << " bytes): "
+		<< chrono::duration<double, micro>(end - start).count() / rounds << " us" << endl;
+}
+
+// 原理图解码性能测试：载入并把BlockData解码为方块空间
+static void bench_sponge_load(const char* path, int rounds) {
+	size_t blocks = 0;
+	auto start = chrono::steady_clock::now();
+	for (auto i = 0; i < rounds; i++)
+		blocks = Schema::SpongeSchematic::load(path).blocks().volume();
+	auto end = chrono::steady_clock::now();
+
+	cout << "sponge load " << path << " (" << blocks << " blocks): "
+		<< chrono::duration<double, micro>(end - start).count() / rounds << " us" << endl;
+}
+
+// 原理图编码性能测试：压缩调色板并编码BlockData，不计压缩与文件写入
+static void bench_sponge_save(const char* path, int rounds) {
+	auto schem = Schema::SpongeSchematic::load(path);
+	size_t total = 0;
+	auto start = chrono::steady_clock::now();
+	for (auto i = 0; i < rounds; i++)
+		total += schem.to_nbt().serialized_size();
+	auto end = chrono::steady_clock::now();
+
+	cout << "sponge save " << path << " (" << total / rounds << " bytes): "
+		<< chrono::duration<double, micro>(end - start).count() / rounds << " us" << endl;
+}
+
+// 位压缩存储性能测试：原理图方块打包为Long_Array再整体解包
+static void bench_packed_storage(const char* path, int rounds) {
+	auto schem = Schema::SpongeSchematic::load(path);
+	const auto& blocks = schem.blocks().blocks();
+	Schema::PackedBlockStorage storage(blocks);
+	std::vector<uint16_t> out(blocks.size());
+	auto start = chrono::steady_clock::now();
+	for (auto i = 0; i < rounds; i++) {
+		storage.pack(blocks);
+		storage.unpack(out);
+	}
+	auto end = chrono::steady_clock::now();
+
+	cout << "packed storage " << path << " (" << storage.bits() << " bits, " << storage.words().size() << " longs): "
+		<< chrono::duration<double, micro>(end - start).count() / rounds << " us" << endl;
+}
+
+// 布局性能测试：按列（y最内层）遍历做六邻域求和，对比线性与Z序分块布局
+template<typename Space>
+static void bench_column_stencil(const char* name, unsigned short n) {
+	Space space(n, n, n);
+	space.for_each([](unsigned short x, unsigned short y, unsigned short z, uint16_t& v) { v = (x * 7 + y * 3 + z) & 15; });
+	uint64_t sum = 0;
+	auto start = chrono::steady_clock::now();
+	for (unsigned short x = 1; x < n - 1; x++)
+		for (unsigned short z = 1; z < n - 1; z++)
+			for (unsigned short y = 1; y < n - 1; y++)
+				sum += space(x - 1, y, z) + space(x + 1, y, z) + space(x, y - 1, z) +
+					space(x, y + 1, z) + space(x, y, z - 1) + space(x, y, z + 1);
+	auto end = chrono::steady_clock::now();
+
+	cout << "column stencil " << name << " " << n << "^3 (" << sum << "): "
+		<< chrono::duration<double, milli>(end - start).count() << " ms" << endl;
+}
+
+// 区域操作性能测试：整个空间替换两次并计数
+static void bench_region(unsigned short width, unsigned short height, unsigned short length, unsigned threads) {
+	Schema::AbstractBlockSpace<uint16_t> space(width, height, length);
+	for (size_t i = 0; i < space.volume(); i++)
+		space.data()[i] = i % 7;
+	auto box = Schema::BlockBox::of(space);
+	Schema::RegionOptions options{ threads };
+	auto start = chrono::steady_clock::now();
+	size_t replaced = Schema::replace(space, box, 3, 10, options) + Schema::replace(space, box, 10, 3, options);
+	size_t counted = Schema::count(space, box, 3, options);
+	auto end = chrono::steady_clock::now();
+
+	cout << "region " << space.volume() << " blocks, " << threads << " threads (" << replaced << ", " << counted << "): "
+		<< chrono::duration<double, milli>(end - start).count() << " ms" << endl;
+}
+
 int main() {
-	//time_t start, end;
-	//start = clock();
-	//for (auto i = 0; i < 10000; i++) {
-	//	//读入文件，注意必须要使用二进制格式打开文件
-	//	NBT_Value nbt{};
-	//	ifstream fin("test/lupine_01.schem", ios::binary);
-	//	fin >> nbt.set_state(NBT_Value::use_gz);
-	//}
-	//end = clock();
-	//
-	//std::cout << "DBSCAN time: " << (end - start) << " ms" << std::endl;
+	bench_load("test/lupine_01.schem", NBT_Value::use_gz, 10000);
+	bench_load("test/lupine_01de.schem", 0, 10000);
+	bench_map_load("test/lupine_01.schem", NBT_Value::use_gz, 10000);
+	bench_map_load("test/lupine_01de.schem", 0, 10000);
+	bench_document_load("test/lupine_01.schem", NBT_Value::use_gz, 10000);
+	bench_document_load("test/lupine_01de.schem", 0, 10000);
+	bench_events("test/lupine_01.schem", NBT_Value::use_gz, 10000);
+	bench_events("test/lupine_01de.schem", 0, 10000);
+	bench_save("test/lupine_01de.schem", 0, 10000);
+	bench_sponge_load("test/lupine_01.schem", 10000);
+	bench_sponge_save("test/lupine_01.schem", 10000);
+	bench_packed_storage("test/lupine_01.schem", 10000);
+	bench_column_stencil<Schema::AbstractBlockSpace<uint16_t>>("yzx", 256);
+	bench_column_stencil<Schema::AbstractBlockSpace<uint16_t, std::vector<uint16_t>, Schema::morton_layout>>("morton", 256);
+	bench_region(512, 256, 512, 1);
+	bench_region(512, 256, 512, 0);
 
 	NBT_Value x{5,6,7};
 	x.get_element_tag();
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <filesystem>
+#include <istream>
+#include <memory>
+#include <memory_resource>
+
+#include "NBT_Value.h"
+
+namespace NBT {
+
+	// A tree parsed into a monotonic arena. Every List, Compound and array of
+	// the tree is carved out of the arena, so a load makes a few large
+	// allocations and clear() or the destructor gives them back at once.
+	// Copies taken out of root(), undecoded use_lazy subtrees included, live
+	// on the default heap with keys of their own; subtrees moved out still
+	// point into the arena and must not outlive the document. A moved-from
+	// document is empty and gets a new arena on its next load.
+	// Compound keys are interned in a string pool, which several documents
+	// may share (see set_string_pool) to store each distinct key only once.
+	class NBT_Document {
+	private:
+		// Declared before _root so the tree is destroyed first.
+		std::unique_ptr<std::pmr::monotonic_buffer_resource> _arena;
+		std::shared_ptr<NBT_StringPool> _pool;
+		NBT_Value _root;
+
+		// The arena, made again if it was moved out.
+		std::pmr::memory_resource* arena();
+
+	public:
+		static constexpr size_t default_arena_size = 64 * 1024;
+
+		explicit NBT_Document(size_t initial_size = default_arena_size);
+
+		NBT_Document(NBT_Document&&) noexcept = default;
+		NBT_Document& operator=(NBT_Document&&) noexcept;
+
+		// Flags are kept on each node; these set them on the root, which
+		// load() and read() go by.
+		NBT_Document& set_state(const int state) { _root.set_state(state); return *this; }
+
+		NBT_Document& unset_state(const int state) { _root.unset_state(state); return *this; }
+
+		// Both drop the current tree first; state flags apply as for NBT_Value.
+		NBT_Document& load(const std::filesystem::path&);
+		NBT_Document& read(std::istream&);
+
+		void clear();
+
+		NBT_Value& root() { return _root; }
+
+		const NBT_Value& root() const { return _root; }
+
+		// For building new nodes that belong to this document; the default
+		// heap once the document was moved from.
+		std::pmr::memory_resource* resource() const {
+			return _arena ? _arena.get() : std::pmr::get_default_resource();
+		}
+
+		// Drops the current tree, whose keys may live in the old pool. The pool
+		// is kept alive by every document holding it; null disables interning.
+		NBT_Document& set_string_pool(std::shared_ptr<NBT_StringPool> pool) {
+			clear();
+			_pool = std::move(pool);
+			return *this;
+		}
+
+		const std::shared_ptr<NBT_StringPool>& string_pool() const { return _pool; }
+	};
+
+}
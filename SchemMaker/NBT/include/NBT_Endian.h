@@ -0,0 +1,85 @@
+#pragma once
+
+#include <bit>
+#include <concepts>
+#include <cstddef>
+#include <stdint.h>
+
+#if defined(_MSC_VER)
+#include <stdlib.h>
+#endif
+
+// NBT_X86_SIMD where the x86 intrinsics are, NBT_SSE2 where SSE2 is always
+// there (x64); anything more is for cpu_simd_level() to say at run time.
+// NBT_TARGET(x) lets GCC and Clang build one function for instruction set x;
+// MSVC needs nothing.
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define NBT_X86_SIMD 1
+#endif
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define NBT_SSE2 1
+#endif
+
+#if defined(NBT_X86_SIMD) && !defined(_MSC_VER)
+#define NBT_TARGET(x) __attribute__((target(x)))
+#else
+#define NBT_TARGET(x)
+#endif
+
+namespace NBT {
+
+	template<std::integral T>
+	inline T byteswap(T v) noexcept {
+		if constexpr (sizeof(T) == 1) {
+			return v;
+		}
+		else if constexpr (sizeof(T) == 2) {
+#if defined(_MSC_VER)
+			return static_cast<T>(_byteswap_ushort(static_cast<uint16_t>(v)));
+#else
+			return static_cast<T>(__builtin_bswap16(static_cast<uint16_t>(v)));
+#endif
+		}
+		else if constexpr (sizeof(T) == 4) {
+#if defined(_MSC_VER)
+			return static_cast<T>(_byteswap_ulong(static_cast<uint32_t>(v)));
+#else
+			return static_cast<T>(__builtin_bswap32(static_cast<uint32_t>(v)));
+#endif
+		}
+		else {
+			static_assert(sizeof(T) == 8);
+#if defined(_MSC_VER)
+			return static_cast<T>(_byteswap_uint64(static_cast<uint64_t>(v)));
+#else
+			return static_cast<T>(__builtin_bswap64(static_cast<uint64_t>(v)));
+#endif
+		}
+	}
+
+	// NBT is big-endian on disk; this is a no-op on big-endian hosts.
+	template<std::integral T>
+	inline T big_endian(T v) noexcept {
+		if constexpr (std::endian::native == std::endian::little)
+			return byteswap(v);
+		else
+			return v;
+	}
+
+	enum class simd_level { none, ssse3, avx2 };
+
+	// Best of the above the CPU has, detected once; none off x86.
+	simd_level cpu_simd_level() noexcept;
+
+	// Reverses the bytes of each width-byte element in place, using AVX2 or
+	// SSSE3 when the CPU has them.
+	void byteswap_array(void* data, size_t count, size_t width) noexcept;
+
+	template<std::integral T>
+	inline void big_endian_array(T* data, size_t count) noexcept {
+		if constexpr (sizeof(T) > 1 && std::endian::native == std::endian::little)
+			byteswap_array(data, count, sizeof(T));
+	}
+
+}
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <filesystem>
+#include <istream>
+#include <span>
+#include <string>
+#include <string_view>
+
+#include "NBT_Value.h"
+#include "NBT_Reader.h"
+#include "NBT_Stream.h"
+#include "NBT_MappedFile.h"
+
+namespace NBT {
+
+	// Default (no-op) events for parse_events(). Events are dispatched on the
+	// handler's static type, so a handler derives from NBT_Handler and
+	// redeclares only what it needs; add `using NBT_Handler::scalar;` (or ::array) when
+	// overloading scalar() or array() for a subset of types. Names, string
+	// values and array chunks are only valid for the duration of the call.
+	struct NBT_Handler {
+		using tag = NBT_Value::tag;
+
+		// Returning false skips the subtree and its end event.
+		bool begin_compound(std::string_view /*name*/) { return true; }
+		void end_compound() {}
+
+		bool begin_list(std::string_view /*name*/, tag /*element_tag*/, Int /*size*/) { return true; }
+		void end_list() {}
+
+		template<typename T>
+		void scalar(tag /*t*/, std::string_view /*name*/, T /*value*/) {}
+
+		void string(std::string_view /*name*/, std::string_view /*value*/) {}
+
+		// Arrays arrive in one or more chunks; offset is the index of chunk[0].
+		// An empty array sends none.
+		template<typename T>
+		void array(tag /*t*/, std::string_view /*name*/, std::span<const T> /*chunk*/, size_t /*offset*/) {}
+	};
+
+	template<typename Handler>
+	class NBT_EventParser {
+	private:
+		using tag = NBT_Value::tag;
+
+		static constexpr size_t chunk_size = 16 * 1024;
+
+		NBT_Reader& _in;
+		Handler& _handler;
+		std::string _name;
+		alignas(8) std::byte _chunk[chunk_size];
+
+		tag read_tag() { return (tag)_in.read<uint8_t>(); }
+
+		Int read_length() {
+			auto len = _in.read<Int>();
+			if (len < 0)
+				throw NBT_Exception("Bad Read: negative length " + std::to_string(len));
+			return len;
+		}
+
+		std::string_view read_name() {
+			auto len = _in.read<uint16_t>();
+			_name.resize(len);
+			_in.read_into(_name.data(), len);
+			return _name;
+		}
+
+		template<typename T>
+		void array(tag t, std::string_view name) {
+			size_t len = (size_t)read_length();
+			size_t offset = 0;
+			while (offset < len) {
+				if constexpr (sizeof(T) == 1) {
+					size_t n = _in.streaming() ? std::min(len - offset, chunk_size) : len - offset;
+					auto bytes = _in.read_bytes(n);
+					_handler.array(t, name, std::span<const T>(reinterpret_cast<const T*>(bytes.data()), n), offset);
+					offset += n;
+				}
+				else {
+					size_t n = std::min(len - offset, chunk_size / sizeof(T));
+					auto values = reinterpret_cast<T*>(_chunk);
+					_in.read_into(values, n * sizeof(T));
+					big_endian_array(values, n);
+					_handler.array(t, name, std::span<const T>(values, n), offset);
+					offset += n;
+				}
+			}
+		}
+
+		void list(std::string_view name) {
+			auto element_tag = read_tag();
+			auto len = read_length();
+			if (!_handler.begin_list(name, element_tag, len)) {
+				for (; len > 0; len--)
+					NBT_Value::skip_binary_payload(_in, element_tag);
+				return;
+			}
+			for (; len > 0; len--)
+				value(element_tag, {});
+			_handler.end_list();
+		}
+
+		void compound(std::string_view name) {
+			if (!_handler.begin_compound(name)) {
+				NBT_Value::skip_binary_payload(_in, tag::TAG_Compound);
+				return;
+			}
+			for (auto t = read_tag(); t != tag::TAG_End; t = read_tag())
+				value(t, read_name());
+			_handler.end_compound();
+		}
+
+		void value(tag t, std::string_view name) {
+			switch (t)
+			{
+			case NBT::NBT_Value::tag::TAG_Byte:			_handler.scalar(t, name, _in.read<Byte>()); break;
+			case NBT::NBT_Value::tag::TAG_Short:		_handler.scalar(t, name, _in.read<Short>()); break;
+			case NBT::NBT_Value::tag::TAG_Int:			_handler.scalar(t, name, _in.read<Int>()); break;
+			case NBT::NBT_Value::tag::TAG_Long:			_handler.scalar(t, name, _in.read<Long>()); break;
+			case NBT::NBT_Value::tag::TAG_Float:		_handler.scalar(t, name, _in.read<Float>()); break;
+			case NBT::NBT_Value::tag::TAG_Double:		_handler.scalar(t, name, _in.read<Double>()); break;
+			case NBT::NBT_Value::tag::TAG_Byte_Array:	array<Byte>(t, name); break;
+			case NBT::NBT_Value::tag::TAG_Int_Array:	array<Int>(t, name); break;
+			case NBT::NBT_Value::tag::TAG_Long_Array:	array<Long>(t, name); break;
+			case NBT::NBT_Value::tag::TAG_List:			list(name); break;
+			case NBT::NBT_Value::tag::TAG_Compound:		compound(name); break;
+			case NBT::NBT_Value::tag::TAG_String: {
+				auto len = _in.read<uint16_t>();
+				auto bytes = _in.read_bytes(len);
+				_handler.string(name, std::string_view(reinterpret_cast<const char*>(bytes.data()), len));
+				break;
+			}
+			default:
+				throw NBT_Exception("Bad Read: unknown tag " + std::to_string((int)t));
+			}
+		}
+
+	public:
+		NBT_EventParser(NBT_Reader& in, Handler& handler) :_in(in), _handler(handler) {
+			_name.reserve(256);
+		}
+
+		void parse() {
+			auto t = read_tag();
+			if (t != tag::TAG_End)
+				value(t, read_name());
+		}
+	};
+
+	// Push-style parse of one named root tag; no NBT_Value nodes are built.
+	template<typename Handler>
+	void parse_events(NBT_Reader& in, Handler& handler) {
+		NBT_EventParser<Handler> parser(in, handler);
+		parser.parse();
+	}
+
+	template<typename Handler>
+	void parse_events(std::istream& is, Handler& handler, int state = 0) {
+		if (state & (NBT_Value::use_gz | NBT_Value::use_zip)) {
+			NBT_InflateSource source(is);
+			NBT_Reader in(source);
+			parse_events(in, handler);
+		}
+		else {
+			NBT_IstreamSource source(is);
+			NBT_Reader in(source);
+			parse_events(in, handler);
+		}
+	}
+
+	template<typename Handler>
+	void parse_events(const std::filesystem::path& path, Handler& handler, int state = 0) {
+		NBT_MappedFile file(path);
+		if (state & (NBT_Value::use_gz | NBT_Value::use_zip)) {
+			NBT_InflateSource source(file.data());
+			NBT_Reader in(source);
+			parse_events(in, handler);
+		}
+		else {
+			NBT_Reader in(file.data());
+			parse_events(in, handler);
+		}
+	}
+
+}
@@ -1,12 +1,12 @@
 #pragma once
 
-#include <exception>
+#include <stdexcept>
 #include <string>
 
 namespace NBT {
-	class NBT_Exception :public std::exception {
+	class NBT_Exception :public std::runtime_error {
 	public:                               
-		NBT_Exception(std::string str) :exception(str.c_str()) {}
+		NBT_Exception(std::string str) :runtime_error(str) {}
 
 	};
 }
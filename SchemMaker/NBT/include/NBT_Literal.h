@@ -1,8 +1,23 @@
 #pragma once
 
+#include <memory_resource>
+#include <string_view>
+
+#include "NBT_Value.h"
+
 namespace NBT {
 
+	// Parses SNBT as printed by to_string() and by Minecraft: typed suffixes
+	// (1b, 2s, 3L, 4.5f, 6.7d), [B;]/[I;]/[L;] arrays, bare or quoted keys
+	// and strings, true/false as bytes. Non-finite floats are written inf,
+	// -inf and nan with their f or d suffix (inff, -infd); Minecraft itself
+	// reads those as strings. The text is read in a single pass
+	// with no copies beyond the nodes built; containers are allocated from
+	// resource (the default heap if null). Throws "Bad Parse" with the
+	// offset of the first error.
+	NBT_Value parse_snbt(std::string_view text, std::pmr::memory_resource* resource = nullptr);
 
+	// "{Name:\"minecraft:stone\",Count:1b}"_snbt
+	NBT_Value operator ""_snbt(const char* v, size_t n);
 
 }
-
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <span>
+
+#include "NBT_Exception.h"
+
+namespace NBT {
+
+	// Read-only memory mapping of a whole file. Files below map_threshold are
+	// read into a buffer instead, mapping them costs more than the copy.
+	class NBT_MappedFile {
+	private:
+		const std::byte* _data = nullptr;
+		size_t _size = 0;
+		std::unique_ptr<std::byte[]> _buffer;
+#if defined(_WIN32)
+		void* _mapping = nullptr;
+#endif
+
+		void unmap() noexcept;
+
+	public:
+		static constexpr size_t map_threshold = 64 * 1024;
+
+		NBT_MappedFile(const std::filesystem::path& path);
+
+		NBT_MappedFile(const NBT_MappedFile&) = delete;
+		NBT_MappedFile& operator=(const NBT_MappedFile&) = delete;
+
+		~NBT_MappedFile() { unmap(); }
+
+		std::span<const std::byte> data() const { return { _data, _size }; }
+
+		size_t size() const { return _size; }
+	};
+
+}
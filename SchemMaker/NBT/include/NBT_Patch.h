@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <variant>
+#include <vector>
+
+#include "NBT_Value.h"
+
+namespace NBT {
+
+	// One step down a tree: a Compound key or a List index.
+	using NBT_PathStep = std::variant<String, Int>;
+	using NBT_Path = std::vector<NBT_PathStep>;
+
+	// Structural difference between two trees, applied in order to turn the
+	// base into the target. Only what changed is kept: Compounds are walked
+	// key by key, node Lists of equal length element by element, and arrays
+	// and packed Lists as runs of changed elements, so a few edits in a large
+	// schematic make a patch of a few bytes.
+	class NBT_Patch {
+	public:
+		enum class op_kind : uint8_t {
+			set = 1,		// path now holds value (added or replaced)
+			remove = 2,		// the Compound entry at path is gone
+			splice = 3		// erase elements [offset, offset + count), insert value's at offset
+		};
+
+		struct operation {
+			op_kind kind;
+			NBT_Path path;
+			// set: the new value. splice: an array of the target's type, or a
+			// List, holding the inserted elements.
+			NBT_Value value;
+			Int offset = 0;
+			Int count = 0;
+		};
+
+		// Equal arrays elements between two changed runs are re-sent rather
+		// than opening a new splice when there are at most this many.
+		static constexpr size_t merge_gap = 8;
+
+	private:
+		std::vector<operation> _operations;
+
+		class differ;
+
+		static NBT_Value& resolve(NBT_Value& root, const NBT_Path& path, size_t depth);
+		static void apply_splice(NBT_Value& target, const operation& op);
+		static NBT_Value read_value(NBT_Reader& in);
+
+	public:
+		NBT_Patch() = default;
+
+		// Patch p such that p.apply(base) makes base == target.
+		static NBT_Patch diff(const NBT_Value& base, const NBT_Value& target);
+
+		bool empty() const { return _operations.empty(); }
+
+		size_t size() const { return _operations.size(); }
+
+		const std::vector<operation>& operations() const { return _operations; }
+
+		// Throws "Bad Patch" if base does not have the shape the patch was
+		// made against; base may then be partly patched.
+		void apply(NBT_Value& base) const;
+
+		// Exact length of the binary encoding.
+		size_t serialized_size() const;
+
+		void write(NBT_Writer&) const;
+
+		// Encodes into a buffer allocated once at its final size.
+		std::vector<std::byte> to_binary() const;
+
+		static NBT_Patch read(NBT_Reader&);
+
+		static NBT_Patch from_binary(std::span<const std::byte> bytes);
+	};
+
+}
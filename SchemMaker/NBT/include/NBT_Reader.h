@@ -0,0 +1,154 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <string>
+#include <stdint.h>
+
+#include "NBT_Endian.h"
+#include "NBT_Exception.h"
+
+namespace NBT {
+
+	// Producer of raw NBT bytes for a streaming NBT_Reader.
+	class NBT_Source {
+	public:
+		virtual ~NBT_Source() = default;
+
+		// Writes at most n bytes to dst and returns how many were written, 0 at end of data.
+		virtual size_t pull(std::byte* dst, size_t n) = 0;
+	};
+
+	// Cursor over an NBT payload. Scalars are decoded with one unaligned load
+	// plus a byteswap. The reader either walks a caller-owned buffer without
+	// copying, or pulls from an NBT_Source through a fixed-size window.
+	class NBT_Reader {
+	private:
+		const std::byte* _cur;
+		const std::byte* _end;
+
+		NBT_Source* _source = nullptr;
+		std::unique_ptr<std::byte[]> _window;
+		size_t _window_size = 0;
+
+		void require(size_t n) {
+			if (static_cast<size_t>(_end - _cur) < n)
+				fill(n);
+		}
+
+		void fill(size_t n) {
+			if (!_source || n > _window_size)
+				throw NBT_Exception("Bad Read: unexpected end of data");
+			size_t have = static_cast<size_t>(_end - _cur);
+			std::memmove(_window.get(), _cur, have);
+			_cur = _window.get();
+			_end = _cur + have;
+			while (have < n) {
+				auto got = _source->pull(_window.get() + have, _window_size - have);
+				if (got == 0)
+					throw NBT_Exception("Bad Read: unexpected end of data");
+				have += got;
+				_end += got;
+			}
+		}
+
+	public:
+		static constexpr size_t default_window_size = 64 * 1024;
+
+		NBT_Reader(std::span<const std::byte> data) :
+			_cur(data.data()), _end(data.data() + data.size()) {}
+
+		NBT_Reader(const void* data, size_t size) :
+			_cur(static_cast<const std::byte*>(data)), _end(static_cast<const std::byte*>(data) + size) {}
+
+		NBT_Reader(NBT_Source& source, size_t window_size = default_window_size) :
+			_source(&source), _window(new std::byte[window_size]), _window_size(window_size) {
+			_cur = _end = _window.get();
+		}
+
+		NBT_Reader(const NBT_Reader&) = delete;
+		NBT_Reader& operator=(const NBT_Reader&) = delete;
+
+		template<std::integral T>
+		T read() {
+			require(sizeof(T));
+			T v;
+			std::memcpy(&v, _cur, sizeof(T));
+			_cur += sizeof(T);
+			return big_endian(v);
+		}
+
+		template<std::floating_point T>
+		T read() {
+			if constexpr (sizeof(T) == 4)
+				return std::bit_cast<T>(read<uint32_t>());
+			else
+				return std::bit_cast<T>(read<uint64_t>());
+		}
+
+		// The returned span is only valid until the next read; when streaming,
+		// n must not exceed the window size.
+		std::span<const std::byte> read_bytes(size_t n) {
+			require(n);
+			std::span<const std::byte> v(_cur, n);
+			_cur += n;
+			return v;
+		}
+
+		// Copies n bytes to dst. Large copies bypass the window and are pulled
+		// from the source straight into dst.
+		void read_into(void* dst, size_t n) {
+			auto out = static_cast<std::byte*>(dst);
+			size_t have = static_cast<size_t>(_end - _cur);
+			if (have >= n || !_source) {
+				require(n);
+				std::memcpy(out, _cur, n);
+				_cur += n;
+				return;
+			}
+			std::memcpy(out, _cur, have);
+			_cur = _end;
+			for (size_t done = have; done < n;) {
+				auto got = _source->pull(out + done, n - done);
+				if (got == 0)
+					throw NBT_Exception("Bad Read: unexpected end of data");
+				done += got;
+			}
+		}
+
+		std::string read_string() {
+			auto len = read<uint16_t>();
+			std::string v(len, '\0');
+			read_into(v.data(), len);
+			return v;
+		}
+
+		void skip(size_t n) {
+			size_t have = static_cast<size_t>(_end - _cur);
+			if (have >= n || !_source) {
+				require(n);
+				_cur += n;
+				return;
+			}
+			_cur = _end;
+			for (n -= have; n > 0;) {
+				auto step = n < _window_size ? n : _window_size;
+				require(step);
+				_cur += step;
+				n -= step;
+			}
+		}
+
+		bool streaming() const { return _source != nullptr; }
+
+		// Current cursor; only stable for readers over a caller-owned buffer.
+		const std::byte* position() const { return _cur; }
+
+		// Bytes available without touching the source.
+		size_t remaining() const { return static_cast<size_t>(_end - _cur); }
+	};
+
+}
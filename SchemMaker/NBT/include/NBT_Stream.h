@@ -0,0 +1,150 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <future>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <span>
+#include <vector>
+
+#include <zlib.h>
+
+#include "NBT_Reader.h"
+#include "NBT_Writer.h"
+
+namespace NBT {
+
+	class NBT_IstreamSource :public NBT_Source {
+	private:
+		std::istream& _in;
+
+	public:
+		NBT_IstreamSource(std::istream& in) :_in(in) {}
+
+		size_t pull(std::byte* dst, size_t n) override;
+	};
+
+	// Inflates a gzip or zlib stream on demand. Only a fixed-size input buffer
+	// is held; decompressed bytes are written straight to the caller.
+	class NBT_InflateSource :public NBT_Source {
+	private:
+		z_stream _strm{};
+		std::istream* _in = nullptr;
+		std::unique_ptr<Bytef[]> _in_buffer;
+		size_t _in_buffer_size = 0;
+		std::span<const std::byte> _in_span;
+		bool _finished = false;
+
+		void init();
+
+	public:
+		static constexpr size_t default_buffer_size = 16 * 1024;
+
+		NBT_InflateSource(std::istream& in, size_t buffer_size = default_buffer_size);
+
+		NBT_InflateSource(std::span<const std::byte> compressed);
+
+		NBT_InflateSource(const NBT_InflateSource&) = delete;
+		NBT_InflateSource& operator=(const NBT_InflateSource&) = delete;
+
+		~NBT_InflateSource();
+
+		size_t pull(std::byte* dst, size_t n) override;
+	};
+
+	// zlib settings for compressed saves: level 0 stores, 1 is fastest and 9
+	// smallest; strategy is one of the Z_* strategies (Z_RLE, Z_FILTERED, ...).
+	// threads other than 1 selects NBT_ParallelDeflateSink, 0 meaning one
+	// per hardware thread.
+	struct NBT_DeflateOptions {
+		int level = Z_DEFAULT_COMPRESSION;
+		int strategy = Z_DEFAULT_STRATEGY;
+		unsigned threads = 1;
+		size_t block_size = 128 * 1024;
+	};
+
+	enum class NBT_Framing : uint8_t { gzip, zlib };
+
+	class NBT_OstreamSink :public NBT_Sink {
+	private:
+		std::ostream& _out;
+
+	public:
+		NBT_OstreamSink(std::ostream& out) :_out(out) {}
+
+		void push(const std::byte* data, size_t n) override;
+	};
+
+	// Deflates bytes as they arrive and writes the compressed output to a
+	// stream through a fixed-size buffer. finish() writes the trailer; a sink
+	// destroyed without it leaves a truncated stream.
+	class NBT_DeflateSink :public NBT_Sink {
+	private:
+		z_stream _strm{};
+		std::ostream& _out;
+		std::unique_ptr<Bytef[]> _out_buffer;
+		size_t _out_buffer_size;
+
+		void deflate_buffer(int flush);
+
+	public:
+		static constexpr size_t default_buffer_size = 64 * 1024;
+
+		NBT_DeflateSink(std::ostream& out, NBT_Framing framing, const NBT_DeflateOptions& options = {},
+			size_t buffer_size = default_buffer_size);
+
+		NBT_DeflateSink(const NBT_DeflateSink&) = delete;
+		NBT_DeflateSink& operator=(const NBT_DeflateSink&) = delete;
+
+		~NBT_DeflateSink();
+
+		void push(const std::byte* data, size_t n) override;
+
+		void finish();
+	};
+
+	// pigz-style compression: input is cut into blocks that are deflated
+	// concurrently, each primed with the last 32K of the block before it, and
+	// joined into a single gzip (or zlib) stream that any inflater reads.
+	// Output is slightly larger than NBT_DeflateSink's and not byte-identical.
+	class NBT_ParallelDeflateSink :public NBT_Sink {
+	private:
+		struct compressed_block {
+			std::vector<Bytef> data;
+			uLong check;
+			size_t size;
+		};
+		using block = std::shared_ptr<const std::vector<Bytef>>;
+
+		std::ostream& _out;
+		NBT_Framing _framing;
+		NBT_DeflateOptions _options;
+		unsigned _threads;
+
+		std::vector<Bytef> _current;
+		block _previous;
+		std::deque<std::future<compressed_block>> _pending;
+		uLong _check;
+		uLong _total = 0;
+
+		static compressed_block compress(block input, block dictionary, bool last, NBT_Framing framing,
+			const NBT_DeflateOptions& options);
+
+		void dispatch(bool last);
+		void write_front();
+		void write_bytes(const void* data, size_t n);
+
+	public:
+		NBT_ParallelDeflateSink(std::ostream& out, NBT_Framing framing, const NBT_DeflateOptions& options);
+
+		NBT_ParallelDeflateSink(const NBT_ParallelDeflateSink&) = delete;
+		NBT_ParallelDeflateSink& operator=(const NBT_ParallelDeflateSink&) = delete;
+
+		void push(const std::byte* data, size_t n) override;
+
+		void finish();
+	};
+
+}
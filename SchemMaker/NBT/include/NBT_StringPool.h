@@ -0,0 +1,174 @@
+#pragma once
+
+#include <compare>
+#include <concepts>
+#include <cstring>
+#include <functional>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <stdint.h>
+
+namespace NBT {
+
+	class NBT_StringPool;
+
+	// Compound key. Keys up to inline_capacity bytes are stored in place,
+	// longer ones on the heap, and keys read through an NBT_StringPool only
+	// point at the pool's copy: equal interned keys share storage and compare
+	// by pointer. Copying an interned key makes an owned copy, so copies stay
+	// valid without the pool; moving keeps the handle.
+	class NBT_Key {
+	private:
+		friend class NBT_StringPool;
+
+		static constexpr size_t inline_capacity = 16;
+
+		enum class storage : uint8_t { in_place, heap, interned };
+
+		union {
+			char _inline[inline_capacity];
+			const char* _ptr;
+		};
+		uint32_t _size = 0;
+		storage _storage = storage::in_place;
+
+		void assign(std::string_view s) {
+			_size = static_cast<uint32_t>(s.size());
+			if (s.size() <= inline_capacity) {
+				_storage = storage::in_place;
+				std::memcpy(_inline, s.data(), s.size());
+			}
+			else {
+				_storage = storage::heap;
+				auto p = new char[s.size()];
+				std::memcpy(p, s.data(), s.size());
+				_ptr = p;
+			}
+		}
+
+		void release() noexcept {
+			if (_storage == storage::heap)
+				delete[] _ptr;
+			_storage = storage::in_place;
+			_size = 0;
+		}
+
+		struct interned_tag {};
+		NBT_Key(const char* pooled, size_t size, interned_tag) :
+			_ptr(pooled), _size(static_cast<uint32_t>(size)), _storage(storage::interned) {}
+
+	public:
+		NBT_Key() :_inline{} {}
+		NBT_Key(std::string_view s) { assign(s); }
+		NBT_Key(const char* s) { assign(s); }
+		NBT_Key(const std::string& s) { assign(s); }
+
+		NBT_Key(const NBT_Key& k) { assign(k.view()); }
+
+		NBT_Key(NBT_Key&& k) noexcept :_size(k._size), _storage(k._storage) {
+			std::memcpy(_inline, k._inline, inline_capacity);
+			k._storage = storage::in_place;
+			k._size = 0;
+		}
+
+		NBT_Key& operator=(const NBT_Key& k) {
+			if (this != &k) {
+				NBT_Key copy(k);
+				*this = std::move(copy);
+			}
+			return *this;
+		}
+
+		NBT_Key& operator=(NBT_Key&& k) noexcept {
+			if (this != &k) {
+				release();
+				_size = k._size;
+				_storage = k._storage;
+				std::memcpy(_inline, k._inline, inline_capacity);
+				k._storage = storage::in_place;
+				k._size = 0;
+			}
+			return *this;
+		}
+
+		~NBT_Key() { release(); }
+
+		const char* data() const { return _storage == storage::in_place ? _inline : _ptr; }
+
+		size_t size() const { return _size; }
+
+		bool empty() const { return _size == 0; }
+
+		bool interned() const { return _storage == storage::interned; }
+
+		std::string_view view() const { return { data(), _size }; }
+
+		operator std::string_view() const { return view(); }
+
+		// Same value as std::hash<std::string_view>; cached for interned keys.
+		size_t hash() const;
+
+		friend bool operator==(const NBT_Key& a, const NBT_Key& b) {
+			if (a._size != b._size)
+				return false;
+			return a.data() == b.data() || std::memcmp(a.data(), b.data(), a._size) == 0;
+		}
+
+		template<typename S>
+			requires std::convertible_to<const S&, std::string_view>
+		friend bool operator==(const NBT_Key& a, const S& b) {
+			return a.view() == std::string_view(b);
+		}
+
+		friend auto operator<=>(const NBT_Key& a, const NBT_Key& b) {
+			return a.view() <=> b.view();
+		}
+	};
+
+	// Deduplicating store for Compound keys, shared by every tree read with
+	// it (see NBT_Document). Strings are never freed before the pool, which
+	// must outlive all keys interned in it. Not thread-safe.
+	class NBT_StringPool {
+	private:
+		struct header {
+			size_t hash;
+			size_t size;
+		};
+
+		std::pmr::monotonic_buffer_resource _arena;
+		// Points at the characters following each header; nullptr if free.
+		std::vector<const char*> _slots;
+		size_t _count = 0;
+		size_t _bytes = 0;
+
+		static const header& header_of(const char* p) {
+			return *reinterpret_cast<const header*>(p - sizeof(header));
+		}
+
+		void grow();
+
+	public:
+		NBT_StringPool() :_slots(256, nullptr) {}
+
+		NBT_StringPool(const NBT_StringPool&) = delete;
+		NBT_StringPool& operator=(const NBT_StringPool&) = delete;
+
+		NBT_Key intern(std::string_view s);
+
+		// Number of distinct strings and the bytes of their characters.
+		size_t size() const { return _count; }
+
+		size_t bytes() const { return _bytes; }
+
+		static size_t cached_hash(const char* pooled) { return header_of(pooled).hash; }
+	};
+
+	inline size_t NBT_Key::hash() const {
+		if (_storage == storage::interned)
+			return NBT_StringPool::cached_hash(_ptr);
+		return std::hash<std::string_view>{}(view());
+	}
+
+}
@@ -3,18 +3,31 @@
 #include <iostream>
 #include <variant>
 #include <vector>
-#include <map>
+#include <string_view>
 #include <type_traits>
 #include <fstream>
 #include <sstream>
 #include <stdint.h>
 #include <algorithm>
+#include <atomic>
 #include <functional>
 #include <optional>
+#include <compare>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <memory_resource>
+#include <span>
+#include <tuple>
+#include <utility>
 
 #include <zlib.h>
 
 #include "NBT_Exception.h"
+#include "NBT_Reader.h"
+#include "NBT_StringPool.h"
+#include "NBT_Writer.h"
+#include "NBT_Stream.h"
 
 #define LIST NBT_Value
 #define CMP NBT_Value
@@ -25,9 +38,30 @@ namespace NBT {
 	constexpr auto NBT_BY_000_Ver = "Alpha 0.2";
 
 	std::string decompressString(const std::string&);
-	std::string compressString(const std::string&);
-
-	extern class NBT_Value;
+	std::string compressString(std::string_view);
+
+	class NBT_Value;
+	class NBT_List;
+	class NBT_Compound;
+
+	template<typename Handler>
+	class NBT_EventParser;
+
+	enum class NBT_Tag : uint8_t {
+		TAG_End			 = 0x00,
+		TAG_Byte		 = 0x01,
+		TAG_Short		 = 0x02,
+		TAG_Int			 = 0x03,
+		TAG_Long		 = 0x04,
+		TAG_Float		 = 0x05,
+		TAG_Double		 = 0x06,
+		TAG_Byte_Array	 = 0x07,
+		TAG_String		 = 0x08,
+		TAG_List		 = 0x09,
+		TAG_Compound	 = 0x0a,
+		TAG_Int_Array	 = 0x0b,
+		TAG_Long_Array	 = 0x0c
+	};
 
 	using End		 = std::monostate;
 	using Byte		 = int8_t;
@@ -36,12 +70,12 @@ namespace NBT {
 	using Long		 = int64_t;
 	using Float		 = float;
 	using Double	 = double;
-	using Byte_Array = std::vector<Byte>;
+	using Byte_Array = std::pmr::vector<Byte>;
 	using String	 = std::string;
-	using List		 = std::vector<NBT_Value>;
-	using Compound	 = std::map<String, NBT_Value>;
-	using Int_Array	 = std::vector<Int>;
-	using Long_Array = std::vector<Long>;
+	using List		 = NBT_List;
+	using Compound	 = NBT_Compound;
+	using Int_Array	 = std::pmr::vector<Int>;
+	using Long_Array = std::pmr::vector<Long>;
 
 	template<typename T>
 	concept NBT_Type =
@@ -74,27 +108,197 @@ namespace NBT {
 		NBT_Type<T> ||
 		NBT_Used_Type<T>;
 
+	// Element types a List stores packed.
+	template<typename T>
+	concept NBT_Packable_Type =
+		std::is_same_v<T, Byte	> ||
+		std::is_same_v<T, Short	> ||
+		std::is_same_v<T, Int	> ||
+		std::is_same_v<T, Long	> ||
+		std::is_same_v<T, Float	> ||
+		std::is_same_v<T, Double>;
+
+	// Payload of a TAG_List. Lists of Byte..Double are packed into one typed
+	// vector; other lists, and any list indexed through operator[], hold full
+	// NBT_Value nodes.
+	class NBT_List {
+	private:
+		friend class NBT_Value;
+		friend class NBT_Patch;
+		friend std::partial_ordering operator<=>(const NBT_List&, const NBT_List&);
+		friend bool operator==(const NBT_List&, const NBT_List&);
+
+		// Alternative n > 0 holds the packed elements of scalar tag n.
+		using storage = std::variant<
+			std::pmr::vector<NBT_Value>,
+			std::pmr::vector<Byte>, std::pmr::vector<Short>, std::pmr::vector<Int>,
+			std::pmr::vector<Long>, std::pmr::vector<Float>, std::pmr::vector<Double>
+		>;
+
+		storage _elements;
+		NBT_Tag _element_tag = NBT_Tag::TAG_End;
+
+		static bool is_packable(NBT_Tag t) { return t >= NBT_Tag::TAG_Byte && t <= NBT_Tag::TAG_Double; }
+
+		std::pmr::memory_resource* resource() const {
+			return std::visit([](const auto& v) { return v.get_allocator().resource(); }, _elements);
+		}
+
+		template<typename T>
+		static constexpr NBT_Tag packed_tag() {
+			if constexpr (std::is_same_v<T, Byte>)		return NBT_Tag::TAG_Byte;
+			else if constexpr (std::is_same_v<T, Short>)	return NBT_Tag::TAG_Short;
+			else if constexpr (std::is_same_v<T, Int>)		return NBT_Tag::TAG_Int;
+			else if constexpr (std::is_same_v<T, Long>)		return NBT_Tag::TAG_Long;
+			else if constexpr (std::is_same_v<T, Float>)	return NBT_Tag::TAG_Float;
+			else {
+				static_assert(std::is_same_v<T, Double>, "List values must be Byte..Double");
+				return NBT_Tag::TAG_Double;
+			}
+		}
+
+	public:
+		explicit NBT_List(std::pmr::memory_resource* resource = std::pmr::get_default_resource()) :
+			_elements(std::in_place_index<0>, resource) {}
+
+		// Empty list of element_tag; Byte..Double get packed storage.
+		explicit NBT_List(NBT_Tag element_tag, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+		NBT_Tag element_tag() const { return _element_tag; }
+
+		size_t size() const { return std::visit([](const auto& v) { return v.size(); }, _elements); }
+
+		bool empty() const { return size() == 0; }
+
+		bool is_packed() const { return _elements.index() != 0; }
+
+		void reserve(size_t n) { std::visit([&](auto& v) { v.reserve(n); }, _elements); }
+
+		// The first element fixes the element tag; later ones must match it.
+		void push_back(NBT_Value v);
+
+		// push_back of NBT_Value(args...); a scalar going into a packed list
+		// of its type is stored directly.
+		template<typename... Args>
+		void emplace_back(Args&&... args);
+
+		// Element nodes; a packed list is unpacked and stays so until values() packs it again.
+		std::pmr::vector<NBT_Value>& nodes();
+
+		NBT_Value& operator[](size_t i) { return nodes()[i]; }
+
+		auto begin() { return nodes().begin(); }
+
+		auto end() { return nodes().end(); }
+
+		// Contiguous elements of a Byte..Double list.
+		template<typename T>
+		std::span<T> values();
+
+		template<typename T>
+		std::span<const T> values() const;
+
+		// Calls f with the backing vector: std::pmr::vector<NBT_Value> or a packed one.
+		template<typename F>
+		decltype(auto) visit(F&& f) const { return std::visit(std::forward<F>(f), _elements); }
+	};
+
+	// Payload of a TAG_Compound: entries in insertion order, which is also
+	// the order they are written in. Compounds above linear_limit entries get
+	// an open-addressing index of entry positions; lookups take a
+	// std::string_view and never allocate. Like a vector, inserting may move
+	// the entries; keys must not be changed through iterators.
+	class NBT_Compound {
+	private:
+		friend std::partial_ordering operator<=>(const NBT_Compound&, const NBT_Compound&);
+		friend bool operator==(const NBT_Compound&, const NBT_Compound&);
+
+	public:
+		using value_type = std::pair<NBT_Key, NBT_Value>;
+		using iterator = std::pmr::vector<value_type>::iterator;
+		using const_iterator = std::pmr::vector<value_type>::const_iterator;
+
+		static constexpr size_t linear_limit = 8;
+
+	private:
+		std::pmr::vector<value_type> _entries;
+		// Slot holds entry position + 1, 0 if free; allocated from the entries' resource.
+		uint32_t* _slots = nullptr;
+		uint32_t _slot_mask = 0;
+
+		static constexpr size_t npos = size_t(-1);
+
+		std::pmr::memory_resource* resource() const { return _entries.get_allocator().resource(); }
+
+		static size_t hash(std::string_view key) { return std::hash<std::string_view>{}(key); }
+
+		size_t find_index(std::string_view key) const;
+		void insert_slot(size_t index);
+		void rebuild_index();
+		void free_index() noexcept;
+		value_type& emplace_new(NBT_Key&& key, NBT_Value&& value);
+		// Indexes the entry just appended.
+		value_type& index_back();
+
+	public:
+		explicit NBT_Compound(std::pmr::memory_resource* resource = std::pmr::get_default_resource()) :
+			_entries(resource) {}
+
+		NBT_Compound(const NBT_Compound&);
+		NBT_Compound(NBT_Compound&&) noexcept;
+		NBT_Compound& operator=(const NBT_Compound&);
+		NBT_Compound& operator=(NBT_Compound&&) noexcept;
+		~NBT_Compound() { free_index(); }
+
+		size_t size() const { return _entries.size(); }
+
+		bool empty() const { return _entries.empty(); }
+
+		void reserve(size_t n) { _entries.reserve(n); }
+
+		iterator begin() { return _entries.begin(); }
+		iterator end() { return _entries.end(); }
+		const_iterator begin() const { return _entries.begin(); }
+		const_iterator end() const { return _entries.end(); }
+
+		iterator find(std::string_view key);
+		const_iterator find(std::string_view key) const;
+
+		bool contains(std::string_view key) const { return find_index(key) != npos; }
+
+		NBT_Value& at(std::string_view key);
+		const NBT_Value& at(std::string_view key) const;
+
+		// Inserts an End value if key is missing.
+		NBT_Value& operator[](std::string_view key);
+
+		// A new key goes last; an existing key keeps its position.
+		template<typename V>
+		std::pair<iterator, bool> insert_or_assign(NBT_Key key, V&& value);
+
+		// Builds NBT_Value(args...) in the entry itself; an existing key is
+		// left as it is, as with std::map::try_emplace.
+		template<typename... Args>
+		std::pair<iterator, bool> try_emplace(NBT_Key key, Args&&... args);
+
+		size_t erase(std::string_view key);
+
+		std::pmr::polymorphic_allocator<value_type> get_allocator() const { return _entries.get_allocator(); }
+	};
+
 	class NBT_Value {
 	public:
+		friend class NBT_List;
+		friend class NBT_Patch;
+		template<typename Handler>
+		friend class NBT_EventParser;
 
 		friend std::ifstream& operator>>(std::ifstream&, NBT_Value&);
 		friend std::ofstream& operator<<(std::ofstream&, NBT_Value&);
+		friend std::partial_ordering operator<=>(const NBT_Value&, const NBT_Value&);
+		friend bool operator==(const NBT_Value&, const NBT_Value&);
 
-		enum class tag {
-			TAG_End			 = 0x00,
-			TAG_Byte		 = 0x01,
-			TAG_Short		 = 0x02,
-			TAG_Int			 = 0x03,
-			TAG_Long		 = 0x04,
-			TAG_Float		 = 0x05,
-			TAG_Double		 = 0x06,
-			TAG_Byte_Array	 = 0x07,
-			TAG_String		 = 0x08,
-			TAG_List		 = 0x09,
-			TAG_Compound	 = 0x0a,
-			TAG_Int_Array	 = 0x0b,
-			TAG_Long_Array	 = 0x0c
-		};
+		using tag = NBT_Tag;
 
 		static std::string tag_string(tag t);
 
@@ -103,28 +307,112 @@ namespace NBT {
 
 		static constexpr int use_gz = 0x0001;
 		static constexpr int use_zip = 0x0002;
+		static constexpr int use_lazy = 0x0004;
+		// Copies of the value share its Compound, List or array until one of
+		// them is changed; see the copy constructors.
+		static constexpr int use_cow = 0x0008;
 
 		static constexpr int snbt_str = 0x0010;
 		static constexpr int json_str = 0x0020;
 		static constexpr int tree_str = 0x0040;
 
+		struct byte_array_visitor { int16_t index; };
+		struct int_array_visitor { int16_t index; };
+		struct long_array_visitor { int16_t index; };
+
 	private:
-		std::variant<
+		// Where decoded containers are allocated, with use_lazy what keeps the
+		// source bytes alive, and where Compound keys are interned (if anywhere);
+		// undecoded subtrees hold the pool so they never intern into a freed one.
+		struct binary_context {
+			std::pmr::memory_resource* resource = std::pmr::get_default_resource();
+			std::shared_ptr<const void> owner;
+			std::shared_ptr<NBT_StringPool> pool;
+		};
+
+		// Undecoded payload of a List, Compound or array, kept alive by context.owner.
+		struct lazy_subtree {
+			binary_context context;
+			std::span<const std::byte> bytes;
+			tag type;
+		};
+		using Lazy = std::shared_ptr<const lazy_subtree>;
+
+		// Payload owned by another node and never changed again; may point
+		// into a larger shared tree (aliasing constructor).
+		using Shared = std::shared_ptr<const NBT_Value>;
+
+		class text_printer;
+		static constexpr size_t lazy_index = 13;
+		static constexpr size_t shared_index = 14;
+
+		using payload_type = std::variant<
 			End, Byte, Short,
 			Int, Long, Float,
 			Double, Byte_Array, String,
 			List, Compound, Int_Array,
-			Long_Array
-		> _value;
+			Long_Array, Lazy, Shared
+		>;
 
-		int _state;
-		tag _list_type;
-		std::optional<tag> _should_be_tag;
+		// mutable: a Lazy value is decoded in place on first access, possibly
+		// through const members. Nothing else changes it through one.
+		mutable payload_type _value;
 
-		NBT_Value& set_list_type(tag type) { _list_type = type; return *this; }
+		// Flags fit in the variant's tail padding next to _should_be_tag; a List
+		// keeps its element tag itself. Zero unless a constructor says
+		// otherwise, so no constructor can leave stray flags set.
+		uint16_t _state = 0;
+		std::optional<tag> _should_be_tag;
+		// Cached hash(), 0 until computed; sits in what was padding. Only kept
+		// on nodes behind a Shared, which never change, so it cannot go stale
+		// when a descendant is changed through a reference. Never copied.
+		mutable uint32_t _hash = 0;
 
 		NBT_Value& set_should_be_tag(tag type) { _should_be_tag = type; return *this; }
 
+		// Every member handing out mutable access calls this first.
+		void reset_hash() { _hash = 0; }
+
+		// frozen: this node is behind a Shared, and so are its descendants.
+		uint64_t content_hash(bool frozen) const;
+
+		// hash() of a node behind a Shared, computed once.
+		uint32_t frozen_hash() const;
+
+		// Mutable payload for the emplace family; End turns into an empty one.
+		Compound& building_compound();
+		List& building_list();
+
+		static bool is_shareable(size_t index) {
+			return index == static_cast<size_t>(tag::TAG_Byte_Array) || index == static_cast<size_t>(tag::TAG_List)
+				|| index == static_cast<size_t>(tag::TAG_Compound) || index == static_cast<size_t>(tag::TAG_Int_Array)
+				|| index == static_cast<size_t>(tag::TAG_Long_Array);
+		}
+
+		// The node holding the payload: this one, or the end of a Shared chain.
+		const NBT_Value& resolved() const {
+			auto v = this;
+			while (v->_value.index() == shared_index)
+				v = std::get<Shared>(v->_value).get();
+			return *v;
+		}
+
+		// For read-only visits; never holds Lazy or Shared.
+		const payload_type& payload() const {
+			auto& v = resolved();
+			v.materialize();
+			return v._value;
+		}
+
+		// With use_cow, moves a Compound, List or array payload behind a
+		// Shared if it is not already behind one.
+		NBT_Value& share();
+
+		// Called before handing out mutable access: decodes a Lazy payload and
+		// gives a Shared one back to this node, copying one level deep with the
+		// children left shared.
+		void unshare();
+
 		void check_should_be() const { 
 			if (_should_be_tag.has_value() ? get_tag() != _should_be_tag.value() : false) {
 				throw NBT_Exception(
@@ -145,405 +433,569 @@ namespace NBT {
 
 #pragma region get_binary_data
 
-		static tag get_binary_tag(std::istringstream& is) {
-			unsigned char v;
-			is >> v;
-			return (tag)v;
+		static tag get_binary_tag(NBT_Reader& in) {
+			return (tag)in.read<uint8_t>();
 		}
 
-		static Byte get_binary_byte(std::istringstream& is) {
-			unsigned char bytes[1]{};
-			is >> bytes[0];
-			Byte v = static_cast<Byte>(bytes[0]);
-			return v;
+		static Byte get_binary_byte(NBT_Reader& in) {
+			return in.read<Byte>();
 		}
 
-		static Short get_binary_short(std::istringstream& is) {
-			unsigned char bytes[2]{};
-			is >> bytes[1] >> bytes[0];
-			Short v = 
-				(static_cast<Short>(bytes[1]) << 8) |
-				static_cast<Short>(bytes[0]);
-			return v;
+		static Short get_binary_short(NBT_Reader& in) {
+			return in.read<Short>();
 		}
 
-		static Int get_binary_int(std::istringstream& is) {
-			unsigned char bytes[4]{};
-			is >> bytes[3] >> bytes[2] >> bytes[1] >> bytes[0];
-			Int v =
-				(static_cast<Int>(bytes[3]) << 24) |
-				(static_cast<Int>(bytes[2]) << 16) |
-				(static_cast<Int>(bytes[1]) << 8) |
-				static_cast<Int>(bytes[0]);
-			return v;
+		static Int get_binary_int(NBT_Reader& in) {
+			return in.read<Int>();
 		}
 
-		static Long get_binary_long(std::istringstream& is) {
-			unsigned char bytes[8]{};
-			is >> bytes[7] >> bytes[6] >> bytes[5] >> bytes[4]
-				>> bytes[3] >> bytes[2] >> bytes[1] >> bytes[0];
-			Long v =
-				(static_cast<Long>(bytes[7]) << 56) |
-				(static_cast<Long>(bytes[6]) << 48) |
-				(static_cast<Long>(bytes[5]) << 40) |
-				(static_cast<Long>(bytes[4]) << 32) |
-				(static_cast<Long>(bytes[3]) << 24) |
-				(static_cast<Long>(bytes[2]) << 16) |
-				(static_cast<Long>(bytes[1]) << 8) |
-				static_cast<Long>(bytes[0]);
-			return v;
+		static Long get_binary_long(NBT_Reader& in) {
+			return in.read<Long>();
 		}
 
-		static Float get_binary_float(std::istringstream& is) {
-			unsigned char bytes[4]{};
-			is >> bytes[3] >> bytes[2] >> bytes[1] >> bytes[0];
-			uint32_t integer_value =
-				(static_cast<uint32_t>(bytes[3]) << 24) |
-				(static_cast<uint32_t>(bytes[2]) << 16) |
-				(static_cast<uint32_t>(bytes[1]) << 8) |
-				static_cast<uint32_t>(bytes[0]);
-			Float v;
-			std::memcpy(&v, &integer_value, sizeof(v));
-			return v;
+		static Float get_binary_float(NBT_Reader& in) {
+			return in.read<Float>();
 		}
 
-		static Double get_binary_double(std::istringstream& is) {
-			unsigned char bytes[8]{};
-			is >> bytes[7] >> bytes[6] >> bytes[5] >> bytes[4]
-				>> bytes[3] >> bytes[2] >> bytes[1] >> bytes[0];
-			uint64_t integer_value =
-				(static_cast<uint64_t>(bytes[7]) << 56) |
-				(static_cast<uint64_t>(bytes[6]) << 48) |
-				(static_cast<uint64_t>(bytes[5]) << 40) |
-				(static_cast<uint64_t>(bytes[4]) << 32) |
-				(static_cast<uint64_t>(bytes[3]) << 24) |
-				(static_cast<uint64_t>(bytes[2]) << 16) |
-				(static_cast<uint64_t>(bytes[1]) << 8) |
-				static_cast<uint64_t>(bytes[0]);
-			Double v;
-			std::memcpy(&v, &integer_value, sizeof(v));
-			return v;
+		static Double get_binary_double(NBT_Reader& in) {
+			return in.read<Double>();
 		}
 
-		static Byte_Array get_binary_byte_array(std::istringstream& is) {
-			Byte_Array v;
-			for (auto len = get_binary_int(is); len > 0; len--) {
-				v.emplace_back(get_binary_byte(is));
+		// Count of elements taking at least element_size bytes each. Over a
+		// buffer it must fit in what is left, so a corrupt length throws
+		// before anything is allocated for it.
+		static Int get_binary_length(NBT_Reader& in, size_t element_size) {
+			auto len = get_binary_int(in);
+			if (len < 0)
+				throw NBT_Exception("Bad Read: negative length " + std::to_string(len));
+			if (!in.streaming() && static_cast<size_t>(len) * element_size > in.remaining())
+				throw NBT_Exception("Bad Read: length " + std::to_string(len) + " runs past the end of data");
+			return len;
+		}
+
+		// Fewest bytes one payload of type t takes.
+		static size_t min_binary_size(tag t) {
+			switch (t)
+			{
+			case NBT::NBT_Value::tag::TAG_End:			return 0;
+			case NBT::NBT_Value::tag::TAG_Byte:			return 1;
+			case NBT::NBT_Value::tag::TAG_Short:		return 2;
+			case NBT::NBT_Value::tag::TAG_Int:			return 4;
+			case NBT::NBT_Value::tag::TAG_Long:			return 8;
+			case NBT::NBT_Value::tag::TAG_Float:		return 4;
+			case NBT::NBT_Value::tag::TAG_Double:		return 8;
+			case NBT::NBT_Value::tag::TAG_Byte_Array:	return 4;
+			case NBT::NBT_Value::tag::TAG_String:		return 2;
+			case NBT::NBT_Value::tag::TAG_List:			return 5;
+			case NBT::NBT_Value::tag::TAG_Compound:		return 1;
+			case NBT::NBT_Value::tag::TAG_Int_Array:	return 4;
+			case NBT::NBT_Value::tag::TAG_Long_Array:	return 4;
+			default:
+				throw NBT_Exception("Bad Read: unknown tag " + std::to_string((int)t));
+			}
+		}
+
+		// Reads len big-endian elements into v. A stream's lengths cannot be
+		// checked up front, so from one v at most doubles per step and a
+		// corrupt length runs out of data long before it runs out of memory.
+		template<typename T>
+		static void get_binary_elements(NBT_Reader& in, std::pmr::vector<T>& v, size_t len) {
+			constexpr size_t first_step = NBT_Reader::default_window_size / sizeof(T);
+			for (size_t done = 0; done < len;) {
+				size_t n = in.streaming() ? std::min(len - done, std::max(first_step, done)) : len;
+				v.resize(done + n);
+				in.read_into(v.data() + done, n * sizeof(T));
+				done += n;
 			}
+			if constexpr (std::is_floating_point_v<T>)
+				big_endian_array(reinterpret_cast<std::conditional_t<sizeof(T) == 4, uint32_t, uint64_t>*>(v.data()), v.size());
+			else
+				big_endian_array(v.data(), v.size());
+		}
+
+		static Byte_Array get_binary_byte_array(NBT_Reader& in, const binary_context& ctx) {
+			Byte_Array v(ctx.resource);
+			get_binary_elements(in, v, get_binary_length(in, sizeof(Byte)));
 			return v;
 		}
 
-		static String get_binary_string(std::istringstream& is) {
+		static String get_binary_string(NBT_Reader& in) {
+			return in.read_string();
+		}
 
-			Short len = get_binary_short(is);
-			char* c = new char[len + 1];
-			c[len] = '\0';
-			is.read(c, len);
-			return c;
+		// Names are viewed in the reader's buffer when possible, so a pooled
+		// key that was seen before costs no allocation at all.
+		static NBT_Key get_binary_key(NBT_Reader& in, const binary_context& ctx) {
+			auto len = in.read<uint16_t>();
+			if (in.remaining() >= len) {
+				auto bytes = in.read_bytes(len);
+				std::string_view name(reinterpret_cast<const char*>(bytes.data()), len);
+				return ctx.pool ? ctx.pool->intern(name) : NBT_Key(name);
+			}
+			String name(len, '\0');
+			in.read_into(name.data(), len);
+			return ctx.pool ? ctx.pool->intern(name) : NBT_Key(name);
 		}
 
-		static NBT_Value get_binary_list(std::istringstream& is) {
-			auto current_tag = get_binary_tag(is);
-			auto len = get_binary_int(is);
-			List v(len);
-			switch (current_tag)
+		static bool is_deferrable(tag t) {
+			return t == tag::TAG_Byte_Array || t == tag::TAG_List || t == tag::TAG_Compound
+				|| t == tag::TAG_Int_Array || t == tag::TAG_Long_Array;
+		}
+
+		// Advances past one payload of type t without decoding it.
+		static void skip_binary_payload(NBT_Reader& in, tag t) {
+			switch (t)
+			{
+			case NBT::NBT_Value::tag::TAG_End:			break;
+			case NBT::NBT_Value::tag::TAG_Byte:			in.skip(1); break;
+			case NBT::NBT_Value::tag::TAG_Short:		in.skip(2); break;
+			case NBT::NBT_Value::tag::TAG_Int:			in.skip(4); break;
+			case NBT::NBT_Value::tag::TAG_Long:			in.skip(8); break;
+			case NBT::NBT_Value::tag::TAG_Float:		in.skip(4); break;
+			case NBT::NBT_Value::tag::TAG_Double:		in.skip(8); break;
+			case NBT::NBT_Value::tag::TAG_Byte_Array:	in.skip((size_t)get_binary_length(in, 1)); break;
+			case NBT::NBT_Value::tag::TAG_String:		in.skip(in.read<uint16_t>()); break;
+			case NBT::NBT_Value::tag::TAG_Int_Array:	in.skip((size_t)get_binary_length(in, 4) * 4); break;
+			case NBT::NBT_Value::tag::TAG_Long_Array:	in.skip((size_t)get_binary_length(in, 8) * 8); break;
+			case NBT::NBT_Value::tag::TAG_List: {
+				auto element_tag = get_binary_tag(in);
+				auto len = get_binary_length(in, min_binary_size(element_tag));
+				switch (element_tag)
+				{
+				case NBT::NBT_Value::tag::TAG_End:		break;
+				case NBT::NBT_Value::tag::TAG_Byte:		in.skip((size_t)len); break;
+				case NBT::NBT_Value::tag::TAG_Short:	in.skip((size_t)len * 2); break;
+				case NBT::NBT_Value::tag::TAG_Int:
+				case NBT::NBT_Value::tag::TAG_Float:	in.skip((size_t)len * 4); break;
+				case NBT::NBT_Value::tag::TAG_Long:
+				case NBT::NBT_Value::tag::TAG_Double:	in.skip((size_t)len * 8); break;
+				default:
+					for (; len > 0; len--)
+						skip_binary_payload(in, element_tag);
+					break;
+				}
+				break;
+			}
+			case NBT::NBT_Value::tag::TAG_Compound:
+				for (auto current_tag = get_binary_tag(in); current_tag != tag::TAG_End; current_tag = get_binary_tag(in)) {
+					in.skip(in.read<uint16_t>());
+					skip_binary_payload(in, current_tag);
+				}
+				break;
+			default:
+				throw NBT_Exception("Bad Read: unknown tag " + std::to_string((int)t));
+			}
+		}
+
+		// Records where the payload lies and skips it; it is decoded by materialize().
+		static NBT_Value get_binary_lazy(NBT_Reader& in, tag t, const binary_context& ctx) {
+			auto begin = in.position();
+			skip_binary_payload(in, t);
+			NBT_Value v;
+			v._value = std::make_shared<const lazy_subtree>(lazy_subtree{
+				ctx, std::span<const std::byte>(begin, in.position()), t });
+			return v;
+		}
+
+		// Called on copies: a Lazy payload is to be decoded onto the default
+		// heap with keys of its own, like a copy of a decoded one, so that it
+		// does not depend on the arena or string pool of the tree it came from.
+		void rebind_lazy();
+
+		void materialize() const {
+			if (_value.index() != lazy_index)
+				return;
+			auto lazy = std::get<Lazy>(_value);
+			NBT_Reader in(lazy->bytes);
+			switch (lazy->type)
 			{
-			case NBT::NBT_Value::tag::TAG_End:
+			case NBT::NBT_Value::tag::TAG_Byte_Array:
+				_value = get_binary_byte_array(in, lazy->context);
 				break;
-			case NBT::NBT_Value::tag::TAG_Byte:
-				std::for_each(v.begin(), v.end(), [&](NBT_Value& e) {e = get_binary_byte(is); });
+			case NBT::NBT_Value::tag::TAG_List:
+				_value = get_binary_list(in, lazy->context);
 				break;
-			case NBT::NBT_Value::tag::TAG_Short:
-				std::for_each(v.begin(), v.end(), [&](NBT_Value& e) {e = get_binary_short(is); });
+			case NBT::NBT_Value::tag::TAG_Compound:
+				_value = get_binary_compound(in, lazy->context);
 				break;
-			case NBT::NBT_Value::tag::TAG_Int:
-				std::for_each(v.begin(), v.end(), [&](NBT_Value& e) {e = get_binary_int(is); });
+			case NBT::NBT_Value::tag::TAG_Int_Array:
+				_value = get_binary_int_array(in, lazy->context);
 				break;
-			case NBT::NBT_Value::tag::TAG_Long:
-				std::for_each(v.begin(), v.end(), [&](NBT_Value& e) {e = get_binary_long(is); });
+			case NBT::NBT_Value::tag::TAG_Long_Array:
+				_value = get_binary_long_array(in, lazy->context);
 				break;
-			case NBT::NBT_Value::tag::TAG_Float:
-				std::for_each(v.begin(), v.end(), [&](NBT_Value& e) {e = get_binary_float(is); });
+			default:
 				break;
-			case NBT::NBT_Value::tag::TAG_Double:
-				std::for_each(v.begin(), v.end(), [&](NBT_Value& e) {e = get_binary_double(is); });
+			}
+		}
+
+		template<typename T>
+		static void get_binary_packed(NBT_Reader& in, List& v, Int len) {
+			get_binary_elements(in, std::get<std::pmr::vector<T>>(v._elements), len);
+		}
+
+		// With an owner, nested containers and arrays are left undecoded (use_lazy).
+		static List get_binary_list(NBT_Reader& in, const binary_context& ctx) {
+			auto current_tag = get_binary_tag(in);
+			auto len = get_binary_length(in, min_binary_size(current_tag));
+			List v(current_tag, ctx.resource);
+			switch (current_tag)
+			{
+			case NBT::NBT_Value::tag::TAG_End:		return v;
+			case NBT::NBT_Value::tag::TAG_Byte:		get_binary_packed<Byte>(in, v, len); return v;
+			case NBT::NBT_Value::tag::TAG_Short:	get_binary_packed<Short>(in, v, len); return v;
+			case NBT::NBT_Value::tag::TAG_Int:		get_binary_packed<Int>(in, v, len); return v;
+			case NBT::NBT_Value::tag::TAG_Long:		get_binary_packed<Long>(in, v, len); return v;
+			case NBT::NBT_Value::tag::TAG_Float:	get_binary_packed<Float>(in, v, len); return v;
+			case NBT::NBT_Value::tag::TAG_Double:	get_binary_packed<Double>(in, v, len); return v;
+			default:
 				break;
+			}
+
+			// From a stream the nodes are added as their data arrives, so that
+			// a corrupt length cannot allocate them all up front.
+			auto& nodes = v.nodes();
+			nodes.reserve(in.streaming() ? std::min<size_t>(len, 1024) : len);
+			auto each = [&](auto get) { for (Int i = 0; i < len; i++) nodes.push_back(NBT_Value(get())); };
+			if (ctx.owner && is_deferrable(current_tag)) {
+				each([&] { return get_binary_lazy(in, current_tag, ctx); });
+			}
+			else switch (current_tag)
+			{
 			case NBT::NBT_Value::tag::TAG_Byte_Array:
-				std::for_each(v.begin(), v.end(), [&](NBT_Value& e) {e = get_binary_byte_array(is); });
+				each([&] { return get_binary_byte_array(in, ctx); });
 				break;
 			case NBT::NBT_Value::tag::TAG_String:
-				std::for_each(v.begin(), v.end(), [&](NBT_Value& e) {e = get_binary_string(is); });
+				each([&] { return get_binary_string(in); });
 				break;
 			case NBT::NBT_Value::tag::TAG_List:
-				std::for_each(v.begin(), v.end(), [&](NBT_Value& e) {e = get_binary_list(is); });
+				each([&] { return get_binary_list(in, ctx); });
 				break;
 			case NBT::NBT_Value::tag::TAG_Compound:
-				std::for_each(v.begin(), v.end(), [&](NBT_Value& e) {e = get_binary_compound(is); });
+				each([&] { return get_binary_compound(in, ctx); });
 				break;
 			case NBT::NBT_Value::tag::TAG_Int_Array:
-				std::for_each(v.begin(), v.end(), [&](NBT_Value& e) {e = get_binary_int_array(is); });
+				each([&] { return get_binary_int_array(in, ctx); });
 				break;
 			case NBT::NBT_Value::tag::TAG_Long_Array:
-				std::for_each(v.begin(), v.end(), [&](NBT_Value& e) {e = get_binary_long_array(is); });
+				each([&] { return get_binary_long_array(in, ctx); });
 				break;
 			default:
-				break;
+				throw NBT_Exception("Bad Read: unknown list element tag " + std::to_string((int)current_tag));
 			}
-			std::for_each(v.begin(), v.end(), [&](auto& _) {_.set_should_be_tag(current_tag); });
-			return ((NBT_Value)std::move(v)).set_list_type(current_tag);
+			std::for_each(nodes.begin(), nodes.end(), [&](auto& _) {_.set_should_be_tag(current_tag); });
+			return v;
+		}
+
+		// Entries are gathered on a per-thread stack first, so that each Compound
+		// is allocated once at its final size.
+		static std::vector<Compound::value_type>& compound_scratch() {
+			thread_local std::vector<Compound::value_type> scratch;
+			return scratch;
 		}
 
-		static Compound get_binary_compound(std::istringstream& is) {
-			Compound v;
+		static Compound get_binary_compound(NBT_Reader& in, const binary_context& ctx) {
+			auto& scratch = compound_scratch();
+			struct scratch_guard {
+				std::vector<Compound::value_type>& scratch;
+				size_t base;
+				~scratch_guard() { scratch.erase(scratch.begin() + base, scratch.end()); }
+			} guard{ scratch, scratch.size() };
 			bool end_flag = false;
 			while (!end_flag) {
-				switch (get_binary_tag(is)) {
+				auto current_tag = get_binary_tag(in);
+				if (ctx.owner && is_deferrable(current_tag)) {
+					auto current_name = get_binary_key(in, ctx);
+					scratch.emplace_back(std::move(current_name), get_binary_lazy(in, current_tag, ctx));
+					continue;
+				}
+				switch (current_tag) {
 				case NBT::NBT_Value::tag::TAG_Byte: {
-					auto current_name = get_binary_string(is);
-					v[current_name] = get_binary_byte(is);
+					auto current_name = get_binary_key(in, ctx);
+					scratch.emplace_back(std::move(current_name), get_binary_byte(in));
 					break;
 				}
 				case NBT::NBT_Value::tag::TAG_Short: {
-					auto current_name = get_binary_string(is);
-					v[current_name] = get_binary_short(is);
+					auto current_name = get_binary_key(in, ctx);
+					scratch.emplace_back(std::move(current_name), get_binary_short(in));
 					break;
 				}
 				case NBT::NBT_Value::tag::TAG_Int: {
-					auto current_name = get_binary_string(is);
-					v[current_name] = get_binary_int(is);
+					auto current_name = get_binary_key(in, ctx);
+					scratch.emplace_back(std::move(current_name), get_binary_int(in));
 					break;
 				}
 				case NBT::NBT_Value::tag::TAG_Long: {
-					auto current_name = get_binary_string(is);
-					v[current_name] = get_binary_long(is);
+					auto current_name = get_binary_key(in, ctx);
+					scratch.emplace_back(std::move(current_name), get_binary_long(in));
 					break;
 				}
 				case NBT::NBT_Value::tag::TAG_Float: {
-					auto current_name = get_binary_string(is);
-					v[current_name] = get_binary_float(is);
+					auto current_name = get_binary_key(in, ctx);
+					scratch.emplace_back(std::move(current_name), get_binary_float(in));
 					break;
 				}
 				case NBT::NBT_Value::tag::TAG_Double: {
-					auto current_name = get_binary_string(is);
-					v[current_name] = get_binary_double(is);
+					auto current_name = get_binary_key(in, ctx);
+					scratch.emplace_back(std::move(current_name), get_binary_double(in));
 					break;
 				}
 				case NBT::NBT_Value::tag::TAG_Byte_Array: {
-					auto current_name = get_binary_string(is);
-					v[current_name] = get_binary_byte_array(is);
+					auto current_name = get_binary_key(in, ctx);
+					scratch.emplace_back(std::move(current_name), get_binary_byte_array(in, ctx));
 					break;
 				}
 				case NBT::NBT_Value::tag::TAG_String: {
-					auto current_name = get_binary_string(is);
-					v[current_name] = get_binary_string(is);
+					auto current_name = get_binary_key(in, ctx);
+					scratch.emplace_back(std::move(current_name), get_binary_string(in));
 					break;
 				}
 				case NBT::NBT_Value::tag::TAG_List: {
-					auto current_name = get_binary_string(is);
-					v[current_name] = get_binary_list(is);
+					auto current_name = get_binary_key(in, ctx);
+					scratch.emplace_back(std::move(current_name), get_binary_list(in, ctx));
 					break;
 				}
 				case NBT::NBT_Value::tag::TAG_Compound: {
-					auto current_name = get_binary_string(is);
-					v[current_name] = get_binary_compound(is);
+					auto current_name = get_binary_key(in, ctx);
+					scratch.emplace_back(std::move(current_name), get_binary_compound(in, ctx));
 					break;
 				}
 				case NBT::NBT_Value::tag::TAG_Int_Array: {
-					auto current_name = get_binary_string(is);
-					v[current_name] = get_binary_int_array(is);
+					auto current_name = get_binary_key(in, ctx);
+					scratch.emplace_back(std::move(current_name), get_binary_int_array(in, ctx));
 					break;
 				}
 				case NBT::NBT_Value::tag::TAG_Long_Array: {
-					auto current_name = get_binary_string(is);
-					v[current_name] = get_binary_long_array(is);
+					auto current_name = get_binary_key(in, ctx);
+					scratch.emplace_back(std::move(current_name), get_binary_long_array(in, ctx));
 					break;
 				}
-				case NBT::NBT_Value::tag::TAG_End: default: {
+				case NBT::NBT_Value::tag::TAG_End: {
 					end_flag = true;
 					break;
 				}
+				default:
+					throw NBT_Exception("Bad Read: unknown tag in Compound");
 				}
 			}
+			Compound v(ctx.resource);
+			v.reserve(scratch.size() - guard.base);
+			for (auto i = guard.base; i < scratch.size(); i++)
+				v.insert_or_assign(std::move(scratch[i].first), std::move(scratch[i].second));
 			return v;
 		}
 
-		static Int_Array get_binary_int_array(std::istringstream& is) {
-			Int_Array v;
-			for (auto len = get_binary_int(is); len > 0; len--) {
-				v.emplace_back(get_binary_int(is));
-			}
+		static Int_Array get_binary_int_array(NBT_Reader& in, const binary_context& ctx) {
+			Int_Array v(ctx.resource);
+			get_binary_elements(in, v, get_binary_length(in, sizeof(Int)));
 			return v;
 		}
 
-		static Long_Array get_binary_long_array(std::istringstream& is) {
-			Long_Array v;
-			for (auto len = get_binary_int(is); len > 0; len--) {
-				v.emplace_back(get_binary_long(is));
+		static Long_Array get_binary_long_array(NBT_Reader& in, const binary_context& ctx) {
+			Long_Array v(ctx.resource);
+			get_binary_elements(in, v, get_binary_length(in, sizeof(Long)));
+			return v;
+		}
+
+		static NBT_Value get_binary_root(NBT_Reader& in, const binary_context& ctx) {
+			NBT_Value v;
+			switch (get_binary_tag(in))
+			{
+			case NBT_Value::tag::TAG_Compound: {
+				auto temp_cmp = Compound(ctx.resource);
+				auto temp_name = get_binary_key(in, ctx);
+				temp_cmp.insert_or_assign(std::move(temp_name), get_binary_compound(in, ctx));
+				v = std::move(temp_cmp);
+				break;
+			}
+			default:
+				break;
 			}
 			return v;
 		}
 
+		// Buffers the whole payload, then parses it with use_lazy semantics.
+		static NBT_Value get_lazy_root(NBT_Source& source, binary_context ctx);
+
 #pragma endregion
 
 #pragma region put_binary_data
 
-		static void put_binary_data(std::ostringstream& os, const NBT_Value& v) {
+		// Bytes put_binary_data writes for v, tag and name excluded.
+		static size_t binary_size(const NBT_Value& v) {
 			struct {
-				void put_binary_tag(std::ostringstream& os, tag _) {
-					os << (unsigned char)_;
+				size_t operator()(const End&) { return 1; }
+				size_t operator()(const Byte&) { return sizeof(Byte); }
+				size_t operator()(const Short&) { return sizeof(Short); }
+				size_t operator()(const Int&) { return sizeof(Int); }
+				size_t operator()(const Long&) { return sizeof(Long); }
+				size_t operator()(const Float&) { return sizeof(Float); }
+				size_t operator()(const Double&) { return sizeof(Double); }
+				size_t operator()(const Byte_Array& v) { return sizeof(Int) + v.size(); }
+				size_t operator()(const String& v) { return sizeof(uint16_t) + v.size(); }
+				size_t operator()(const List& v) {
+					size_t n = 1 + sizeof(Int);
+					v.visit([&](const auto& elements) {
+						using T = typename std::decay_t<decltype(elements)>::value_type;
+						if constexpr (std::is_same_v<T, NBT_Value>) {
+							for (auto& _ : elements)
+								n += binary_size(_);
+						}
+						else
+							n += elements.size() * sizeof(T);
+						});
+					return n;
 				}
-				void operator()(std::ostringstream& os, const End& v, tag list_tag) {
-					put_binary_tag(os, tag::TAG_End);
+				size_t operator()(const Compound& v) {
+					size_t n = 1;
+					for (const auto& [key, value] : v)
+						n += 1 + sizeof(uint16_t) + key.size() + binary_size(value);
+					return n;
 				}
-				void operator()(std::ostringstream& os, const Byte& v, tag list_tag) {
-					const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&v);
-					os << bytes[0];
-				}
-				void operator()(std::ostringstream& os, const Short& v, tag list_tag) {
-					const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&v);
-					os << bytes[1] << bytes[0];
-				}
-				void operator()(std::ostringstream& os, const Int& v, tag list_tag) {
-					const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&v);
-					os << bytes[3] << bytes[2] << bytes[1] << bytes[0];
+				size_t operator()(const Int_Array& v) { return sizeof(Int) + v.size() * sizeof(Int); }
+				size_t operator()(const Long_Array& v) { return sizeof(Int) + v.size() * sizeof(Long); }
+				size_t operator()(const Lazy& v) { return v->bytes.size(); }
+				size_t operator()(const Shared& v) { return binary_size(*v); }
+			}binary_size_visitor;
+			return std::visit(binary_size_visitor, v._value);
+		}
+
+		static void put_binary_data(NBT_Writer& out, const NBT_Value& v) {
+			struct {
+				NBT_Writer& out;
+				void put_binary_tag(tag _) {
+					out.write(static_cast<uint8_t>(_));
 				}
-				void operator()(std::ostringstream& os, const Long& v, tag list_tag) {
-					const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&v);
-					os << bytes[7] << bytes[6] << bytes[5] << bytes[4]
-						<< bytes[3] << bytes[2] << bytes[1] << bytes[0];
+				void operator()(const End&) {
+					put_binary_tag(tag::TAG_End);
 				}
-				void operator()(std::ostringstream& os, const Float& v, tag list_tag) {
-					const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&v);
-					os << bytes[3] << bytes[2] << bytes[1] << bytes[0];
+				void operator()(const Byte& v) { out.write(v); }
+				void operator()(const Short& v) { out.write(v); }
+				void operator()(const Int& v) { out.write(v); }
+				void operator()(const Long& v) { out.write(v); }
+				void operator()(const Float& v) { out.write(v); }
+				void operator()(const Double& v) { out.write(v); }
+				void operator()(const Byte_Array& v) {
+					out.write((Int)v.size());
+					out.write_bytes(v.data(), v.size());
 				}
-				void operator()(std::ostringstream& os, const Double& v, tag list_tag) {
-					const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&v);
-					os << bytes[7] << bytes[6] << bytes[5] << bytes[4]
-						<< bytes[3] << bytes[2] << bytes[1] << bytes[0];
+				void operator()(const String& v) {
+					out.write_string(v);
 				}
-				void operator()(std::ostringstream& os, const Byte_Array& v, tag list_tag) {
-					this->operator()(os, (Int)v.size(), list_tag);
-					for (auto& _ : v)
-						this->operator()(os, _, list_tag);
+				void operator()(const List& v) {
+					put_binary_tag(v.element_tag());
+					out.write((Int)v.size());
+					v.visit([&](const auto& elements) {
+						using T = typename std::decay_t<decltype(elements)>::value_type;
+						if constexpr (std::is_same_v<T, NBT_Value>) {
+							for (auto& _ : elements)
+								put_binary_data(out, _);
+						}
+						else if constexpr (sizeof(T) == 1)
+							out.write_bytes(elements.data(), elements.size());
+						else if constexpr (std::is_floating_point_v<T>)
+							out.write_array(reinterpret_cast<const std::conditional_t<sizeof(T) == 4, uint32_t, uint64_t>*>(elements.data()), elements.size());
+						else
+							out.write_array(elements.data(), elements.size());
+						});
 				}
-				void operator()(std::ostringstream& os, const String& v, tag list_tag) {
-					uint16_t len = v.size();
-					const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&len);
-					os << bytes[1] << bytes[0];
-					for (auto& _ : v)
-						this->operator()(os, (Byte)_, list_tag);
+				void operator()(const Compound& v) {
+					for (const auto& [key, value] : v) {
+						put_binary_tag(value.get_tag());
+						out.write_string(key);
+						put_binary_data(out, value);
+					}
+					put_binary_tag(tag::TAG_End);
 				}
-				void operator()(std::ostringstream& os, const List& v, tag list_tag) {
-					put_binary_tag(os, list_tag);
-					this->operator()(os, (Int)v.size(), list_tag);
-					for (auto& _ : v)
-						put_binary_data(os, _);
+				void operator()(const Int_Array& v) {
+					out.write((Int)v.size());
+					out.write_array(v.data(), v.size());
 				}
-				void operator()(std::ostringstream& os, const Compound& v, tag list_tag) {
-					for (const auto& [tag, value] : v) {
-						put_binary_tag(os, value.get_tag());
-						put_binary_data(os, NBT_Value(tag));
-						put_binary_data(os, value);
-					}
-					put_binary_tag(os, tag::TAG_End);
+				void operator()(const Long_Array& v) {
+					out.write((Int)v.size());
+					out.write_array(v.data(), v.size());
 				}
-				void operator()(std::ostringstream& os, const Int_Array& v, tag list_tag) {
-					this->operator()(os, (Int)v.size(), list_tag);
-					for (auto& _ : v)
-						this->operator()(os, _, list_tag);
+				void operator()(const Lazy& v) {
+					// untouched subtree: copy the original bytes
+					out.write_bytes(v->bytes.data(), v->bytes.size());
 				}
-				void operator()(std::ostringstream& os, const Long_Array& v, tag list_tag) {
-					this->operator()(os, (Int)v.size(), list_tag);
-					for (auto& _ : v)
-						this->operator()(os, _, list_tag);
+				void operator()(const Shared& v) {
+					put_binary_data(out, *v);
 				}
-			}put_binary_visitor;
-			return std::visit([&](auto&& _) {
-				return put_binary_visitor(os, _, v._list_type);
-				}, v._value);
+			}put_binary_visitor{ out };
+			std::visit(put_binary_visitor, v._value);
 		}
 
 #pragma endregion
 
 	public:
 
-		NBT_Value() :_state(0), _list_type(tag::TAG_End) {}
+		NBT_Value() :_state(0) {}
 
 		template<NBT_Surpported_Type T>
-		explicit NBT_Value(const T& value, int state = 0) : _value(value), _state(state) {
-			_list_type = get_element_tag();
-		}
+		explicit NBT_Value(const T& value, int state = 0) : _value(value), _state(static_cast<uint16_t>(state)) { share(); }
 
 		template<NBT_Surpported_Type T>
-		explicit NBT_Value(T&& value, int state = 0) : _value(std::move(value)), _state(state), _list_type(tag::TAG_End) {
-			_list_type = get_element_tag();
-		}
+		explicit NBT_Value(T&& value, int state = 0) : _value(std::move(value)), _state(static_cast<uint16_t>(state)) { share(); }
 
-		explicit NBT_Value(const char* s, int state = 0) :_value(s), _state(state), _list_type(tag::TAG_End) {}
+		explicit NBT_Value(const char* s, int state = 0) :_value(s), _state(static_cast<uint16_t>(state)) {}
 
 		NBT_Value(std::initializer_list<std::pair<std::string, NBT_Value>>);
 
 		template<typename T>
 			requires NBT_Surpported_Type<T>	&& NBT_Not_Null<T>
-		NBT_Value(std::initializer_list<T> il) {
-			std::vector<NBT_Value> value(il.size());
-			int i = 0;
-			for (auto& v : il) {
-				value[i] = v;
-				i++;
-			}
-			_list_type = value.empty() ? tag::TAG_End : value[0].get_tag();
-			std::for_each(value.begin(), value.end(), [&](auto& _) {_.set_should_be_tag(_list_type); });
+		NBT_Value(std::initializer_list<T> il) :_state(0) {
+			List value;
+			for (auto& v : il)
+				value.push_back(NBT_Value(v));
 			_value = std::move(value);
 		}
 
-		NBT_Value(std::initializer_list<const char*> il) {
-			std::vector<NBT_Value> value;
-			_list_type = tag::TAG_String;
-			for (auto& v : il) {
+		NBT_Value(std::initializer_list<const char*> il) :_state(0) {
+			List value(tag::TAG_String);
+			for (auto& v : il)
 				value.push_back(NBT_Value(v));
-			}
-			std::for_each(value.begin(), value.end(), [&](auto& _) {_.set_should_be_tag(_list_type); });
 			_value = std::move(value);
 		}
 
-		NBT_Value(std::initializer_list<Byte> il) {
-			std::vector<Byte> value;
-			_list_type = tag::TAG_String;
-			for (auto& v : il) {
-				value.push_back(v);
-			}
-			_value = std::move(value);
+		NBT_Value(std::initializer_list<Byte> il) :_state(0) {
+			_value = Byte_Array(il);
 		}
 
-		NBT_Value(std::initializer_list<Int> il) {
-			std::vector<Int> value;
-			_list_type = tag::TAG_String;
-			for (auto& v : il) {
-				value.push_back(v);
-			}
-			_value = std::move(value);
+		NBT_Value(std::initializer_list<Int> il) :_state(0) {
+			_value = Int_Array(il);
 		}
 
-		NBT_Value(std::initializer_list<Long> il) {
-			std::vector<Long> value;
-			_list_type = tag::TAG_String;
-			for (auto& v : il) {
-				value.push_back(v);
-			}
-			_value = std::move(value);
+		NBT_Value(std::initializer_list<Long> il) :_state(0) {
+			_value = Long_Array(il);
 		}
 
 		NBT_Value(NBT_Value&& v) noexcept :
-			_value(std::move(v._value)),_list_type(v._list_type),_should_be_tag(v._should_be_tag), _state(v._state) {}
+			_value(std::move(v._value)), _state(v._state), _should_be_tag(v._should_be_tag) {}
 
+		// A Shared value copies as a pointer; anything else is copied deeply,
+		// onto the default heap. A const value is never changed by being
+		// copied, so copies of it are safe from any thread and leave references
+		// into it valid.
 		NBT_Value(const NBT_Value& v):
-			_value(v._value), _list_type(v._list_type), _should_be_tag(v._should_be_tag), _state(v._state) {}
+			_value(v._value), _state(v._state), _should_be_tag(v._should_be_tag)
+		{
+			if (_value.index() == lazy_index)
+				rebind_lazy();
+		}
+
+		// A use_cow value holding a Compound, List or array is moved behind a
+		// Shared first, so the copy and the original both point to it; the
+		// copy keeps use_cow. set_state(use_cow) does the move already, so
+		// this only happens again after the original was changed, and then
+		// invalidates references into its payload taken since.
+		NBT_Value(NBT_Value& v) : NBT_Value(std::as_const(v.share())) {}
 
 		template<typename T>
 			requires  NBT_Surpported_Type<T>
 		NBT_Value& operator=(const T& value) {
 			_value = value;
+			reset_hash();
 			check_should_be();
 			return *this;
 		}
@@ -552,6 +1004,7 @@ namespace NBT {
 			requires  NBT_Surpported_Type<T>
 		NBT_Value& operator=(T&& value) {
 			_value = std::move(value);
+			reset_hash();
 			check_should_be();
 			return *this;
 		}
@@ -559,6 +1012,7 @@ namespace NBT {
 		NBT_Value& operator=(const char* value) {
 			check_should_be(tag::TAG_String);
 			_value = String(value);
+			reset_hash();
 			check_should_be();
 			return *this;
 		}
@@ -566,40 +1020,321 @@ namespace NBT {
 		NBT_Value& operator=(NBT_Value&& v) noexcept {
 			check_should_be(v.get_tag());
 			_value = std::move(v._value);
-			_list_type = v._list_type;
 			_should_be_tag = v._should_be_tag;
+			reset_hash();
 			return *this;
 		}
 
 		NBT_Value& operator=(const NBT_Value& v) {
 			check_should_be(v.get_tag());
 			_value = v._value;
-			_list_type = v._list_type;
 			_should_be_tag = v._should_be_tag;
+			reset_hash();
+			if (_value.index() == lazy_index)
+				rebind_lazy();
 			return *this;
 		}
 
+		// Shares a use_cow payload first, as the copy constructor does.
+		NBT_Value& operator=(NBT_Value& v) { return *this = std::as_const(v.share()); }
+
 		template<NBT_Type T>
 		T& get() {
+			unshare();
+			reset_hash();
 			return std::get<T>(_value);
 		}
 
-		NBT_Value& set_state(const int state) { _state |= state; return *this; }
-
-		NBT_Value& unset_state(const int state) { _state &= ~state; return *this; }
+		// Read-only access; keeps the cached hash.
+		template<NBT_Type T>
+		const T& get() const {
+			return std::get<T>(payload());
+		}
 
-		std::string to_string() const;
+		// Setting use_cow shares the payload at once, so later copies need not
+		// move it.
+		NBT_Value& set_state(const int state) { _state |= static_cast<uint16_t>(state); return share(); }
+
+		NBT_Value& unset_state(const int state) { _state &= static_cast<uint16_t>(~state); return *this; }
+
+		// Content hash: equal for values that compare ==, whatever the Compound
+		// entry order or List packing, and the same on every run and platform.
+		// A tree is walked in full each time, except for payloads shared by
+		// use_cow copies: those never change, so their hash is cached and all
+		// copies reuse it, and operator== tells two of them apart by it.
+		// Callers hashing one changing tree repeatedly should keep the result.
+		uint32_t hash() const;
+
+		// Text dump in the format chosen by format, or by this value's own
+		// flags if format is 0: snbt_str (the default), json_str, or tree_str
+		// (indented, arrays shown by length only).
+		std::string to_string(int format = 0) const;
+
+		// Streaming counterparts of to_string(): the first appends to out, the
+		// second writes to os in chunks. Neither copies any subtree.
+		void print(std::string& out, int format = 0) const;
+		void print(std::ostream& os, int format = 0) const;
+
+		// Exact length of the binary encoding written by operator<<, before
+		// compression.
+		size_t serialized_size() const { return binary_size(*this); }
+
+		// Encodes into out, which must hold serialized_size() bytes; returns
+		// the bytes written.
+		size_t write_binary(std::span<std::byte> out) const;
+
+		// Encodes into a buffer allocated once at its final size.
+		std::vector<std::byte> to_binary() const;
+
+		// Streams the encoding to out through a fixed-size window, deflating
+		// it on the fly with use_gz (gzip framing) or use_zip (zlib framing);
+		// operator<< is write(out).
+		void write(std::ostream&, const NBT_DeflateOptions& options = {}) const;
+
+		// Appends the uncompressed encoding to a writer over any sink; the
+		// caller flushes it.
+		void write(NBT_Writer&) const;
+
+		// File counterpart of write(); the file is replaced.
+		void save(const std::filesystem::path&, const NBT_DeflateOptions& options = {}) const;
+
+		// Memory-maps the file and parses it in place; honours use_gz (or
+		// use_zip, either framing is accepted) like operator>>.
+		// With use_lazy, Lists, Compounds and arrays are decoded on first access
+		// and the mapping (or inflated buffer) lives as long as any of them.
+		// Containers are allocated from resource (the default heap if null).
+		// Compound keys are interned in pool if given. Undecoded subtrees keep
+		// it alive, but decoded keys point into it, so hold it as long as the tree.
+		NBT_Value& load(const std::filesystem::path&, std::pmr::memory_resource* resource = nullptr,
+			std::shared_ptr<NBT_StringPool> pool = nullptr);
+
+		// Stream counterpart of load(); operator>> is read(in).
+		NBT_Value& read(std::istream&, std::pmr::memory_resource* resource = nullptr,
+			std::shared_ptr<NBT_StringPool> pool = nullptr);
 
 		bool if_use_gz() const { return _state & use_gz; }
 
-		NBT_Value& add_tag(std::string, NBT_Value);
+		bool if_use_zip() const { return _state & use_zip; }
+
+		bool if_use_lazy() const { return _state & use_lazy; }
+
+		bool if_use_cow() const { return _state & use_cow; }
+
+		NBT_Value& add_tag(std::string_view, NBT_Value);
+
+		// In-place building, top-down and without temporaries. On a Compound
+		// (an End value becomes an empty one) emplace builds NBT_Value(args...)
+		// directly in the new entry and returns it; an existing key is left as
+		// it is. Returned references last until the parent's next insertion.
+		template<typename... Args>
+		NBT_Value& emplace(std::string_view key, Args&&... args);
+
+		NBT_Value& emplace_compound(std::string_view key, size_t capacity = 0);
+
+		// Empty List of T; Byte..Double lists are packed.
+		template<NBT_Type T>
+		NBT_Value& emplace_list(std::string_view key, size_t capacity = 0);
+
+		// List counterparts (an End value becomes an empty List). emplace_back
+		// returns this List for chaining, the others the new element.
+		template<typename... Args>
+		NBT_Value& emplace_back(Args&&... args);
+
+		NBT_Value& emplace_back_compound(size_t capacity = 0);
+
+		template<NBT_Type T>
+		NBT_Value& emplace_back_list(size_t capacity = 0);
+
+		// Capacity hint for a Compound or List.
+		NBT_Value& reserve(size_t n);
+
+		// Rvalue-only counterparts of the initializer_list constructors: each
+		// entry ("Count"_tag << 1_b) or element is moved in once, where an
+		// initializer_list can only be copied from.
+		template<typename... Entries>
+			requires (std::is_same_v<Entries, std::pair<std::string, NBT_Value>> && ...)
+		static NBT_Value make_compound(Entries&&... entries);
+
+		template<NBT_Type T, typename... Elements>
+			requires (!std::is_lvalue_reference_v<Elements> && ...)
+		static NBT_Value make_list(Elements&&... elements);
 
-		NBT_Value& operator[](std::string);
+		template<NBT_Type T>
+		static constexpr tag tag_of() {
+			if constexpr (std::is_same_v<T, End>)				return tag::TAG_End;
+			else if constexpr (std::is_same_v<T, Byte>)			return tag::TAG_Byte;
+			else if constexpr (std::is_same_v<T, Short>)		return tag::TAG_Short;
+			else if constexpr (std::is_same_v<T, Int>)			return tag::TAG_Int;
+			else if constexpr (std::is_same_v<T, Long>)			return tag::TAG_Long;
+			else if constexpr (std::is_same_v<T, Float>)		return tag::TAG_Float;
+			else if constexpr (std::is_same_v<T, Double>)		return tag::TAG_Double;
+			else if constexpr (std::is_same_v<T, Byte_Array>)	return tag::TAG_Byte_Array;
+			else if constexpr (std::is_same_v<T, String>)		return tag::TAG_String;
+			else if constexpr (std::is_same_v<T, List>)			return tag::TAG_List;
+			else if constexpr (std::is_same_v<T, Compound>)		return tag::TAG_Compound;
+			else if constexpr (std::is_same_v<T, Int_Array>)	return tag::TAG_Int_Array;
+			else												return tag::TAG_Long_Array;
+		}
+
+		NBT_Value& operator[](std::string_view);
 
 		NBT_Value& operator[](int);
 
+		Byte& operator[](byte_array_visitor);
+
+		Int& operator[](int_array_visitor);
+
+		Long& operator[](long_array_visitor);
+
 	};
 
+	template<typename... Args>
+	void NBT_List::emplace_back(Args&&... args) {
+		if constexpr (sizeof...(Args) == 1 && (NBT_Packable_Type<std::decay_t<Args>> && ...)) {
+			using T = std::tuple_element_t<0, std::tuple<std::decay_t<Args>...>>;
+			if (auto v = std::get_if<std::pmr::vector<T>>(&_elements)) {
+				v->push_back(args...);
+				return;
+			}
+		}
+		push_back(NBT_Value(std::forward<Args>(args)...));
+	}
+
+	template<typename... Args>
+	NBT_Value& NBT_Value::emplace(std::string_view key, Args&&... args) {
+		return building_compound().try_emplace(NBT_Key(key), std::forward<Args>(args)...).first->second;
+	}
+
+	template<NBT_Type T>
+	NBT_Value& NBT_Value::emplace_list(std::string_view key, size_t capacity) {
+		auto& v = emplace(key, List(tag_of<T>()));
+		return v.reserve(capacity);
+	}
+
+	template<typename... Args>
+	NBT_Value& NBT_Value::emplace_back(Args&&... args) {
+		building_list().emplace_back(std::forward<Args>(args)...);
+		return *this;
+	}
+
+	template<NBT_Type T>
+	NBT_Value& NBT_Value::emplace_back_list(size_t capacity) {
+		auto& list = building_list();
+		list.push_back(NBT_Value(List(tag_of<T>())));
+		return list.nodes().back().reserve(capacity);
+	}
+
+	template<typename... Entries>
+		requires (std::is_same_v<Entries, std::pair<std::string, NBT_Value>> && ...)
+	NBT_Value NBT_Value::make_compound(Entries&&... entries) {
+		Compound cmp;
+		cmp.reserve(sizeof...(entries));
+		(cmp.insert_or_assign(NBT_Key(entries.first), std::move(entries.second)), ...);
+		return NBT_Value(std::move(cmp));
+	}
+
+	template<NBT_Type T, typename... Elements>
+		requires (!std::is_lvalue_reference_v<Elements> && ...)
+	NBT_Value NBT_Value::make_list(Elements&&... elements) {
+		List list(tag_of<T>());
+		list.reserve(sizeof...(elements));
+		(list.emplace_back(std::move(elements)), ...);
+		return NBT_Value(std::move(list));
+	}
+
+	template<typename T>
+	std::span<T> NBT_List::values() {
+		using packed = std::pmr::vector<T>;
+		if (auto v = std::get_if<packed>(&_elements))
+			return *v;
+		if (!empty() && _element_tag != packed_tag<T>())
+			throw NBT_Exception("Bad Visit: List of " + NBT_Value::tag_string(_element_tag) + " read as " + NBT_Value::tag_string(packed_tag<T>()));
+		auto& nodes = std::get<0>(_elements);
+		packed v(resource());
+		v.reserve(nodes.size());
+		for (auto& node : nodes)
+			v.push_back(node.get<T>());
+		_element_tag = packed_tag<T>();
+		_elements = std::move(v);
+		return std::get<packed>(_elements);
+	}
+
+	template<typename T>
+	std::span<const T> NBT_List::values() const {
+		if (auto v = std::get_if<std::pmr::vector<T>>(&_elements))
+			return *v;
+		throw NBT_Exception("Bad Visit: List is not a packed List of " + NBT_Value::tag_string(packed_tag<T>()));
+	}
+
+	inline size_t NBT_Compound::find_index(std::string_view key) const {
+		if (!_slots) {
+			for (size_t i = 0; i < _entries.size(); i++)
+				if (_entries[i].first == key)
+					return i;
+			return npos;
+		}
+		for (size_t i = hash(key) & _slot_mask;; i = (i + 1) & _slot_mask) {
+			auto slot = _slots[i];
+			if (slot == 0)
+				return npos;
+			if (_entries[slot - 1].first == key)
+				return slot - 1;
+		}
+	}
+
+	inline NBT_Compound::iterator NBT_Compound::find(std::string_view key) {
+		auto i = find_index(key);
+		return i == npos ? end() : begin() + i;
+	}
+
+	inline NBT_Compound::const_iterator NBT_Compound::find(std::string_view key) const {
+		auto i = find_index(key);
+		return i == npos ? end() : begin() + i;
+	}
+
+	inline NBT_Value& NBT_Compound::at(std::string_view key) {
+		auto i = find_index(key);
+		if (i == npos)
+			throw NBT_Exception("Bad Visit: no tag named " + String(key));
+		return _entries[i].second;
+	}
+
+	inline const NBT_Value& NBT_Compound::at(std::string_view key) const {
+		auto i = find_index(key);
+		if (i == npos)
+			throw NBT_Exception("Bad Visit: no tag named " + String(key));
+		return _entries[i].second;
+	}
+
+	inline NBT_Value& NBT_Compound::operator[](std::string_view key) {
+		auto i = find_index(key);
+		if (i != npos)
+			return _entries[i].second;
+		return emplace_new(NBT_Key(key), NBT_Value()).second;
+	}
+
+	template<typename V>
+	std::pair<NBT_Compound::iterator, bool> NBT_Compound::insert_or_assign(NBT_Key key, V&& value) {
+		auto i = find_index(key);
+		if (i != npos) {
+			_entries[i].second = NBT_Value(std::forward<V>(value));
+			return { begin() + i, false };
+		}
+		emplace_new(std::move(key), NBT_Value(std::forward<V>(value)));
+		return { end() - 1, true };
+	}
+
+	template<typename... Args>
+	std::pair<NBT_Compound::iterator, bool> NBT_Compound::try_emplace(NBT_Key key, Args&&... args) {
+		auto i = find_index(key);
+		if (i != npos)
+			return { begin() + i, false };
+		_entries.emplace_back(std::piecewise_construct,
+			std::forward_as_tuple(std::move(key)), std::forward_as_tuple(std::forward<Args>(args)...));
+		index_back();
+		return { end() - 1, true };
+	}
+
 	class tag_builder :public std::string {
 	public:
 		tag_builder(std::string s) :std::string(s) {}
@@ -607,13 +1342,16 @@ namespace NBT {
 		template<class T>
 			requires NBT_Surpported_Type<T> || std::convertible_to<T, NBT_Value> || std::is_same_v<T, const char *>
 		friend std::pair<std::string, NBT_Value> operator<<(const tag_builder s, T t) {
-			NBT_Value v = NBT_Value(t);
-			return std::make_pair((std::string)s, v);
+			return std::make_pair((std::string)s, NBT_Value(std::move(t)));
 		}
 	};
 
 	std::ifstream& operator>>(std::ifstream&, NBT_Value&);
 
+	std::partial_ordering operator<=>(const NBT_Value&, const NBT_Value&);
+
+	bool operator==(const NBT_Value&, const NBT_Value&);
+
 	constexpr Byte operator ""_b(unsigned long long v) {
 		return Byte(v);
 	}
@@ -652,4 +1390,16 @@ namespace NBT {
 
 	tag_builder operator ""_tag(const char* v, size_t n);
 
+	NBT_Value::byte_array_visitor operator ""_B(unsigned long long v);
+
+	NBT_Value::int_array_visitor operator ""_I(unsigned long long v);
+
+	NBT_Value::long_array_visitor operator ""_L(unsigned long long v);
+
 }
+
+// For unordered containers keyed by content, e.g. deduplicating subtrees.
+template<>
+struct std::hash<NBT::NBT_Value> {
+	size_t operator()(const NBT::NBT_Value& v) const { return v.hash(); }
+};
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <stdint.h>
+
+#include "NBT_Endian.h"
+#include "NBT_Exception.h"
+
+namespace NBT {
+
+	// Consumer of raw NBT bytes for a streaming NBT_Writer.
+	class NBT_Sink {
+	public:
+		virtual ~NBT_Sink() = default;
+
+		// Takes all n bytes; reports failure by throwing.
+		virtual void push(const std::byte* data, size_t n) = 0;
+	};
+
+	// Cursor producing an NBT payload, the counterpart of NBT_Reader. The
+	// writer either fills a caller-owned buffer, sized with
+	// NBT_Value::serialized_size() (running past its end throws), or hands
+	// a fixed-size window to an NBT_Sink whenever it fills up.
+	class NBT_Writer {
+	private:
+		std::byte* _begin;
+		std::byte* _cur;
+		std::byte* _end;
+
+		NBT_Sink* _sink = nullptr;
+		std::unique_ptr<std::byte[]> _window;
+		size_t _flushed = 0;
+
+		size_t available() const { return static_cast<size_t>(_end - _cur); }
+
+		void require(size_t n) {
+			if (available() < n)
+				drain(n);
+		}
+
+		void drain(size_t n) {
+			if (!_sink || n > static_cast<size_t>(_end - _begin))
+				throw NBT_Exception("Bad Write: buffer too small");
+			flush();
+		}
+
+	public:
+		static constexpr size_t default_window_size = 64 * 1024;
+		// Room for the widest scalar, so a flushed window always takes one more.
+		static constexpr size_t min_window_size = sizeof(uint64_t);
+
+		NBT_Writer(std::span<std::byte> out) :
+			_begin(out.data()), _cur(out.data()), _end(out.data() + out.size()) {}
+
+		// Smaller windows are rounded up to min_window_size.
+		NBT_Writer(NBT_Sink& sink, size_t window_size = default_window_size) :
+			_sink(&sink) {
+			window_size = std::max(window_size, min_window_size);
+			_window.reset(new std::byte[window_size]);
+			_begin = _cur = _window.get();
+			_end = _begin + window_size;
+		}
+
+		NBT_Writer(const NBT_Writer&) = delete;
+		NBT_Writer& operator=(const NBT_Writer&) = delete;
+
+		template<std::integral T>
+		void write(T v) {
+			require(sizeof(T));
+			v = big_endian(v);
+			std::memcpy(_cur, &v, sizeof(T));
+			_cur += sizeof(T);
+		}
+
+		template<std::floating_point T>
+		void write(T v) {
+			if constexpr (sizeof(T) == 4)
+				write(std::bit_cast<uint32_t>(v));
+			else
+				write(std::bit_cast<uint64_t>(v));
+		}
+
+		// Large writes to a sink bypass the window.
+		void write_bytes(const void* data, size_t n) {
+			if (available() >= n || !_sink) {
+				require(n);
+				std::memcpy(_cur, data, n);
+				_cur += n;
+				return;
+			}
+			flush();
+			if (n >= static_cast<size_t>(_end - _begin)) {
+				_sink->push(static_cast<const std::byte*>(data), n);
+				_flushed += n;
+				return;
+			}
+			std::memcpy(_cur, data, n);
+			_cur += n;
+		}
+
+		// Copies the elements, then swaps them in place in the output; through
+		// a sink this goes one window at a time.
+		template<std::integral T>
+		void write_array(const T* data, size_t count) {
+			while (count > 0) {
+				size_t n = count;
+				if (_sink && available() < n * sizeof(T)) {
+					if (available() < sizeof(T))
+						flush();
+					n = std::min(count, available() / sizeof(T));
+				}
+				require(n * sizeof(T));
+				std::memcpy(_cur, data, n * sizeof(T));
+				// _cur may be unaligned for T, so swap through the untyped overload
+				if constexpr (sizeof(T) > 1 && std::endian::native == std::endian::little)
+					byteswap_array(_cur, n, sizeof(T));
+				_cur += n * sizeof(T);
+				data += n;
+				count -= n;
+			}
+		}
+
+		void write_string(std::string_view s) {
+			if (s.size() > UINT16_MAX)
+				throw NBT_Exception("Bad Write: string longer than 65535 bytes");
+			write(static_cast<uint16_t>(s.size()));
+			write_bytes(s.data(), s.size());
+		}
+
+		// Hands the window to the sink; a no-op when writing to a buffer.
+		void flush() {
+			if (!_sink || _cur == _begin)
+				return;
+			_sink->push(_begin, static_cast<size_t>(_cur - _begin));
+			_flushed += static_cast<size_t>(_cur - _begin);
+			_cur = _begin;
+		}
+
+		size_t written() const { return _flushed + static_cast<size_t>(_cur - _begin); }
+	};
+
+}
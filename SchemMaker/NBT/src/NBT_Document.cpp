@@ -0,0 +1,47 @@
+#include "NBT_Document.h"
+
+namespace NBT {
+
+	NBT_Document::NBT_Document(size_t initial_size) :
+		_arena(std::make_unique<std::pmr::monotonic_buffer_resource>(initial_size)),
+		_pool(std::make_shared<NBT_StringPool>()) {}
+
+	NBT_Document& NBT_Document::operator=(NBT_Document&& other) noexcept
+	{
+		// The old tree has to go before the arena it was allocated from.
+		_root = NBT_Value();
+		_arena = std::move(other._arena);
+		_pool = std::move(other._pool);
+		_root = std::move(other._root);
+		return *this;
+	}
+
+	std::pmr::memory_resource* NBT_Document::arena()
+	{
+		if (!_arena)
+			_arena = std::make_unique<std::pmr::monotonic_buffer_resource>(default_arena_size);
+		return _arena.get();
+	}
+
+	NBT_Document& NBT_Document::load(const std::filesystem::path& path)
+	{
+		clear();
+		_root.load(path, arena(), _pool);
+		return *this;
+	}
+
+	NBT_Document& NBT_Document::read(std::istream& in)
+	{
+		clear();
+		_root.read(in, arena(), _pool);
+		return *this;
+	}
+
+	void NBT_Document::clear()
+	{
+		_root = NBT_Value();
+		if (_arena)
+			_arena->release();
+	}
+
+}
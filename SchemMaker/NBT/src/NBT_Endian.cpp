@@ -0,0 +1,130 @@
+#include "NBT_Endian.h"
+
+#include <cstring>
+
+#ifdef NBT_X86_SIMD
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+namespace NBT {
+
+	namespace {
+
+		template<typename T>
+		void byteswap_scalar(std::byte* p, size_t count) noexcept {
+			for (size_t i = 0; i < count; i++, p += sizeof(T)) {
+				T v;
+				std::memcpy(&v, p, sizeof(T));
+				v = byteswap(v);
+				std::memcpy(p, &v, sizeof(T));
+			}
+		}
+
+		void byteswap_tail(std::byte* p, size_t count, size_t width) noexcept {
+			switch (width) {
+			case 2: byteswap_scalar<uint16_t>(p, count); break;
+			case 4: byteswap_scalar<uint32_t>(p, count); break;
+			case 8: byteswap_scalar<uint64_t>(p, count); break;
+			default: break;
+			}
+		}
+
+#ifdef NBT_X86_SIMD
+
+		// pshufb control bytes reversing each 2/4/8 byte group of a 16 byte lane
+		alignas(16) constexpr int8_t shuffle_2[16] = { 1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14 };
+		alignas(16) constexpr int8_t shuffle_4[16] = { 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 };
+		alignas(16) constexpr int8_t shuffle_8[16] = { 7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8 };
+
+		const int8_t* shuffle_for(size_t width) noexcept {
+			return width == 2 ? shuffle_2 : width == 4 ? shuffle_4 : shuffle_8;
+		}
+
+		NBT_TARGET("avx2")
+		size_t byteswap_avx2(std::byte* p, size_t bytes, size_t width) noexcept {
+			const __m128i lane = _mm_load_si128(reinterpret_cast<const __m128i*>(shuffle_for(width)));
+			const __m256i mask = _mm256_broadcastsi128_si256(lane);
+			size_t i = 0;
+			for (; i + 64 <= bytes; i += 64) {
+				__m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+				__m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i + 32));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(p + i), _mm256_shuffle_epi8(a, mask));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(p + i + 32), _mm256_shuffle_epi8(b, mask));
+			}
+			for (; i + 32 <= bytes; i += 32) {
+				__m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(p + i), _mm256_shuffle_epi8(a, mask));
+			}
+			return i;
+		}
+
+		NBT_TARGET("ssse3")
+		size_t byteswap_ssse3(std::byte* p, size_t bytes, size_t width) noexcept {
+			const __m128i mask = _mm_load_si128(reinterpret_cast<const __m128i*>(shuffle_for(width)));
+			size_t i = 0;
+			for (; i + 16 <= bytes; i += 16) {
+				__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(p + i), _mm_shuffle_epi8(a, mask));
+			}
+			return i;
+		}
+
+		simd_level detect_simd() noexcept {
+#if defined(_MSC_VER)
+			int info[4];
+			__cpuid(info, 0);
+			int max_leaf = info[0];
+			__cpuid(info, 1);
+			bool ssse3 = (info[2] & (1 << 9)) != 0;
+			bool osxsave = (info[2] & (1 << 27)) != 0;
+			bool avx = (info[2] & (1 << 28)) != 0;
+			bool avx2 = false;
+			if (max_leaf >= 7) {
+				__cpuidex(info, 7, 0);
+				avx2 = (info[1] & (1 << 5)) != 0;
+			}
+			if (avx2 && avx && osxsave && (_xgetbv(0) & 0x6) == 0x6)
+				return simd_level::avx2;
+			return ssse3 ? simd_level::ssse3 : simd_level::none;
+#else
+			__builtin_cpu_init();
+			if (__builtin_cpu_supports("avx2"))
+				return simd_level::avx2;
+			if (__builtin_cpu_supports("ssse3"))
+				return simd_level::ssse3;
+			return simd_level::none;
+#endif
+		}
+
+#endif
+
+	}
+
+	simd_level cpu_simd_level() noexcept {
+#ifdef NBT_X86_SIMD
+		static const simd_level level = detect_simd();
+		return level;
+#else
+		return simd_level::none;
+#endif
+	}
+
+	void byteswap_array(void* data, size_t count, size_t width) noexcept {
+		if (width < 2)
+			return;
+		auto p = static_cast<std::byte*>(data);
+		size_t done = 0;
+#ifdef NBT_X86_SIMD
+		const simd_level level = cpu_simd_level();
+		if (level == simd_level::avx2)
+			done = byteswap_avx2(p, count * width, width);
+		else if (level == simd_level::ssse3)
+			done = byteswap_ssse3(p, count * width, width);
+#endif
+		byteswap_tail(p + done, count - done / width, width);
+	}
+
+}
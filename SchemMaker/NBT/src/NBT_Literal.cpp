@@ -1 +1,317 @@
 #include "NBT_Literal.h"
+
+#include <charconv>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace NBT {
+
+	namespace {
+
+		class snbt_parser {
+		private:
+			const char* _begin;
+			const char* _cur;
+			const char* _end;
+			std::pmr::memory_resource* _resource;
+
+			[[noreturn]] void fail(const std::string& what) const {
+				throw NBT_Exception("Bad Parse: " + what + " at offset " + std::to_string(_cur - _begin));
+			}
+
+			static bool is_bare(char c) {
+				return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+					|| c == '_' || c == '-' || c == '.' || c == '+';
+			}
+
+			void skip_space() {
+				while (_cur < _end && (*_cur == ' ' || *_cur == '\t' || *_cur == '\n' || *_cur == '\r'))
+					_cur++;
+			}
+
+			bool accept(char c) {
+				skip_space();
+				if (_cur < _end && *_cur == c) {
+					_cur++;
+					return true;
+				}
+				return false;
+			}
+
+			void expect(char c) {
+				if (!accept(c))
+					fail(std::string("expected '") + c + "'");
+			}
+
+			// Separator after an element: true to go on, false at the closing bracket.
+			bool next(char close) {
+				if (accept(','))
+					return !accept(close);
+				if (accept(close))
+					return false;
+				fail(std::string("expected ',' or '") + close + "'");
+			}
+
+			std::string_view bare_word() {
+				auto start = _cur;
+				while (_cur < _end && is_bare(*_cur))
+					_cur++;
+				return { start, size_t(_cur - start) };
+			}
+
+			// Views the text directly unless the string has escapes, in which
+			// case it is unescaped into storage.
+			std::string_view quoted_string(String& storage) {
+				char quote = *_cur++;
+				auto start = _cur;
+				while (_cur < _end && *_cur != quote && *_cur != '\\')
+					_cur++;
+				if (_cur < _end && *_cur == quote)
+					return { start, size_t(_cur++ - start) };
+				auto& v = storage;
+				v.assign(start, _cur);
+				while (_cur < _end && *_cur != quote) {
+					char c = *_cur++;
+					if (c == '\\') {
+						if (_cur == _end)
+							break;
+						c = *_cur++;
+						switch (c) {
+						case 'n': c = '\n'; break;
+						case 't': c = '\t'; break;
+						case 'r': c = '\r'; break;
+						default: break;
+						}
+					}
+					v += c;
+				}
+				if (_cur == _end)
+					fail("unterminated string");
+				_cur++;
+				return v;
+			}
+
+			String quoted_string() {
+				String storage;
+				auto v = quoted_string(storage);
+				return v.data() == storage.data() ? std::move(storage) : String(v);
+			}
+
+			template<typename T>
+			static bool to_number(std::string_view s, T& v) {
+				if (!s.empty() && s.front() == '+')
+					s.remove_prefix(1);
+				auto [p, ec] = std::from_chars(s.data(), s.data() + s.size(), v);
+				return ec == std::errc() && p == s.data() + s.size();
+			}
+
+			// The spellings to_string() gives non-finite floats; from_chars
+			// takes more, but which ones is up to the library.
+			template<typename T>
+			static bool to_floating(std::string_view s, T& v) {
+				if (s == "inf" || s == "+inf")
+					v = std::numeric_limits<T>::infinity();
+				else if (s == "-inf")
+					v = -std::numeric_limits<T>::infinity();
+				else if (s == "nan")
+					v = std::numeric_limits<T>::quiet_NaN();
+				else
+					return !s.empty() && to_number(s, v);
+				return true;
+			}
+
+			static bool is_integer(std::string_view s) {
+				if (!s.empty() && (s.front() == '-' || s.front() == '+'))
+					s.remove_prefix(1);
+				return !s.empty() && std::all_of(s.begin(), s.end(), [](char c) { return c >= '0' && c <= '9'; });
+			}
+
+			// A bare word is a number if it reads as one, otherwise a string.
+			NBT_Value scalar(std::string_view s) {
+				if (s.empty())
+					fail("expected a value");
+				char suffix = s.back();
+				auto digits = s.substr(0, s.size() - 1);
+				switch (suffix) {
+				case 'b': case 'B': {
+					Byte v;
+					if (is_integer(digits) && to_number(digits, v))
+						return NBT_Value(v);
+					break;
+				}
+				case 's': case 'S': {
+					Short v;
+					if (is_integer(digits) && to_number(digits, v))
+						return NBT_Value(v);
+					break;
+				}
+				case 'l': case 'L': {
+					Long v;
+					if (is_integer(digits) && to_number(digits, v))
+						return NBT_Value(v);
+					break;
+				}
+				case 'f': case 'F': {
+					Float v;
+					if (to_floating(digits, v))
+						return NBT_Value(v);
+					break;
+				}
+				case 'd': case 'D': {
+					Double v;
+					if (to_floating(digits, v))
+						return NBT_Value(v);
+					break;
+				}
+				default:
+					break;
+				}
+				if (is_integer(s)) {
+					Int v;
+					if (to_number(s, v))
+						return NBT_Value(v);
+				}
+				else if (s.find_first_of(".eE") != std::string_view::npos) {
+					Double v;
+					if (to_number(s, v))
+						return NBT_Value(v);
+				}
+				if (s == "true")
+					return NBT_Value(Byte(1));
+				if (s == "false")
+					return NBT_Value(Byte(0));
+				return NBT_Value(String(s));
+			}
+
+			// Array elements are plain integers, so they skip the scalar() guesswork.
+			template<typename T>
+			T array_element(char suffix) {
+				skip_space();
+				auto start = _cur;
+				bool negative = false;
+				if (_cur < _end && (*_cur == '-' || *_cur == '+'))
+					negative = *_cur++ == '-';
+				auto digits = _cur;
+				uint64_t v = 0;
+				while (_cur < _end && static_cast<unsigned>(*_cur - '0') < 10 && _cur - digits < 19)
+					v = v * 10 + static_cast<unsigned>(*_cur++ - '0');
+				if (suffix && _cur < _end && (*_cur == suffix || *_cur == suffix - 'a' + 'A'))
+					_cur++;
+				uint64_t limit = static_cast<uint64_t>(std::numeric_limits<T>::max()) + (negative ? 1 : 0);
+				if (_cur == digits || v > limit || (_cur < _end && is_bare(*_cur))) {
+					_cur = start;
+					fail("bad array element '" + std::string(bare_word()) + "'");
+				}
+				return static_cast<T>(negative ? 0 - v : v);
+			}
+
+			template<typename Array>
+			NBT_Value array(char suffix) {
+				using T = typename Array::value_type;
+				Array v(_resource);
+				if (!accept(']')) {
+					do
+						v.push_back(array_element<T>(suffix));
+					while (next(']'));
+				}
+				return NBT_Value(std::move(v));
+			}
+
+			NBT_Value list() {
+				_cur++;
+				skip_space();
+				if (_end - _cur >= 2 && _cur[1] == ';') {
+					char type = _cur[0];
+					_cur += 2;
+					switch (type) {
+					case 'B': return array<Byte_Array>('b');
+					case 'I': return array<Int_Array>(0);
+					case 'L': return array<Long_Array>('l');
+					default: fail(std::string("unknown array type '") + type + "'");
+					}
+				}
+				List v(_resource);
+				if (!accept(']')) {
+					do
+						v.push_back(value());
+					while (next(']'));
+				}
+				return NBT_Value(std::move(v));
+			}
+
+			// Entries are gathered on a per-thread stack first, as in the binary
+			// decoder, so that each Compound is allocated once at its final size.
+			static std::vector<Compound::value_type>& compound_scratch() {
+				thread_local std::vector<Compound::value_type> scratch;
+				return scratch;
+			}
+
+			NBT_Value compound() {
+				_cur++;
+				auto& scratch = compound_scratch();
+				struct scratch_guard {
+					std::vector<Compound::value_type>& scratch;
+					size_t base;
+					~scratch_guard() { scratch.erase(scratch.begin() + base, scratch.end()); }
+				} guard{ scratch, scratch.size() };
+				String storage;
+				if (!accept('}')) {
+					do {
+						skip_space();
+						if (_cur == _end)
+							fail("unterminated compound");
+						auto key = *_cur == '"' || *_cur == '\'' ? quoted_string(storage) : bare_word();
+						// an empty bare word is no key at all, while "" is a valid one
+						if (key.empty() && key.data() == _cur)
+							fail("expected a key");
+						NBT_Key name(key);
+						expect(':');
+						scratch.emplace_back(std::move(name), value());
+					} while (next('}'));
+				}
+				Compound v(_resource);
+				v.reserve(scratch.size() - guard.base);
+				for (auto i = guard.base; i < scratch.size(); i++)
+					v.insert_or_assign(std::move(scratch[i].first), std::move(scratch[i].second));
+				return NBT_Value(std::move(v));
+			}
+
+		public:
+			snbt_parser(std::string_view text, std::pmr::memory_resource* resource) :
+				_begin(text.data()), _cur(text.data()), _end(text.data() + text.size()), _resource(resource) {}
+
+			NBT_Value value() {
+				skip_space();
+				if (_cur == _end)
+					fail("unexpected end of text");
+				switch (*_cur) {
+				case '{': return compound();
+				case '[': return list();
+				case '"': case '\'': return NBT_Value(quoted_string());
+				default: return scalar(bare_word());
+				}
+			}
+
+			NBT_Value parse() {
+				auto v = value();
+				skip_space();
+				if (_cur != _end)
+					fail("trailing characters");
+				return v;
+			}
+		};
+
+	}
+
+	NBT_Value parse_snbt(std::string_view text, std::pmr::memory_resource* resource)
+	{
+		return snbt_parser(text, resource ? resource : std::pmr::get_default_resource()).parse();
+	}
+
+	NBT_Value operator ""_snbt(const char* v, size_t n)
+	{
+		return parse_snbt(std::string_view(v, n));
+	}
+
+}
@@ -0,0 +1,116 @@
+#include "NBT_MappedFile.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace NBT {
+
+#if defined(_WIN32)
+
+	NBT_MappedFile::NBT_MappedFile(const std::filesystem::path& path)
+	{
+		HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+			OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			throw NBT_Exception("Bad Open: cannot open " + path.string());
+
+		LARGE_INTEGER size{};
+		if (!GetFileSizeEx(file, &size)) {
+			CloseHandle(file);
+			throw NBT_Exception("Bad Open: cannot stat " + path.string());
+		}
+		_size = static_cast<size_t>(size.QuadPart);
+		if (_size == 0) {
+			CloseHandle(file);
+			return;
+		}
+		if (_size < map_threshold) {
+			_buffer.reset(new std::byte[_size]);
+			DWORD got = 0;
+			BOOL ok = ReadFile(file, _buffer.get(), static_cast<DWORD>(_size), &got, nullptr);
+			CloseHandle(file);
+			if (!ok || got != _size)
+				throw NBT_Exception("Bad Open: cannot read " + path.string());
+			_data = _buffer.get();
+			return;
+		}
+
+		_mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		CloseHandle(file);
+		if (!_mapping)
+			throw NBT_Exception("Bad Open: cannot map " + path.string());
+
+		_data = static_cast<const std::byte*>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+		if (!_data) {
+			CloseHandle(_mapping);
+			throw NBT_Exception("Bad Open: cannot map " + path.string());
+		}
+	}
+
+	void NBT_MappedFile::unmap() noexcept
+	{
+		if (_data && !_buffer)
+			UnmapViewOfFile(_data);
+		if (_mapping)
+			CloseHandle(_mapping);
+	}
+
+#else
+
+	NBT_MappedFile::NBT_MappedFile(const std::filesystem::path& path)
+	{
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+			throw NBT_Exception("Bad Open: cannot open " + path.string());
+
+		struct stat st {};
+		if (::fstat(fd, &st) != 0) {
+			::close(fd);
+			throw NBT_Exception("Bad Open: cannot stat " + path.string());
+		}
+		_size = static_cast<size_t>(st.st_size);
+		if (_size == 0) {
+			::close(fd);
+			return;
+		}
+		if (_size < map_threshold) {
+			_buffer.reset(new std::byte[_size]);
+			size_t done = 0;
+			while (done < _size) {
+				auto got = ::read(fd, _buffer.get() + done, _size - done);
+				if (got <= 0)
+					break;
+				done += static_cast<size_t>(got);
+			}
+			::close(fd);
+			if (done != _size)
+				throw NBT_Exception("Bad Open: cannot read " + path.string());
+			_data = _buffer.get();
+			return;
+		}
+
+		void* p = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (p == MAP_FAILED)
+			throw NBT_Exception("Bad Open: cannot map " + path.string());
+		::madvise(p, _size, MADV_SEQUENTIAL);
+		_data = static_cast<const std::byte*>(p);
+	}
+
+	void NBT_MappedFile::unmap() noexcept
+	{
+		if (_data && !_buffer)
+			::munmap(const_cast<std::byte*>(_data), _size);
+	}
+
+#endif
+
+}
@@ -0,0 +1,400 @@
+#include "NBT_Patch.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+namespace NBT {
+
+	namespace {
+
+		constexpr char patch_magic[4] = { 'N', 'B', 'T', 'P' };
+		constexpr uint8_t patch_version = 1;
+
+		[[noreturn]] void bad_patch(const std::string& what) {
+			throw NBT_Exception("Bad Patch: " + what);
+		}
+
+	}
+
+	// Walks both trees together, appending an operation wherever they part.
+	class NBT_Patch::differ {
+	private:
+		std::vector<operation>& _operations;
+		NBT_Path _path;
+
+		void emit(op_kind kind, NBT_Value value = NBT_Value(), size_t offset = 0, size_t count = 0) {
+			_operations.push_back({ kind, _path, std::move(value), static_cast<Int>(offset), static_cast<Int>(count) });
+		}
+
+		template<typename T>
+		static NBT_Value slice(std::span<const T> v, NBT_Tag element_tag) {
+			if constexpr (std::is_same_v<T, NBT_Value>) {
+				List list(element_tag);
+				auto& nodes = std::get<0>(list._elements);
+				nodes.assign(v.begin(), v.end());
+				return NBT_Value(std::move(list));
+			}
+			else {
+				// TAG_End stands for a bare array rather than a packed List
+				if constexpr (std::is_same_v<T, Byte> || std::is_same_v<T, Int> || std::is_same_v<T, Long>) {
+					if (element_tag == NBT_Tag::TAG_End)
+						return NBT_Value(std::pmr::vector<T>(v.begin(), v.end()));
+				}
+				List list(element_tag);
+				std::get<std::pmr::vector<T>>(list._elements).assign(v.begin(), v.end());
+				return NBT_Value(std::move(list));
+			}
+		}
+
+		// Common prefix and suffix are kept. Equal lengths give one splice per
+		// run of changed elements (Lists of nodes recurse instead); otherwise
+		// the middle is replaced by one splice.
+		template<typename T>
+		void sequence(std::span<const T> a, std::span<const T> b, NBT_Tag element_tag) {
+			size_t n = std::min(a.size(), b.size());
+			size_t prefix = 0;
+			while (prefix < n && a[prefix] == b[prefix])
+				prefix++;
+			if (a.size() != b.size()) {
+				size_t suffix = 0;
+				while (suffix < n - prefix && a[a.size() - 1 - suffix] == b[b.size() - 1 - suffix])
+					suffix++;
+				emit(op_kind::splice, slice(b.subspan(prefix, b.size() - prefix - suffix), element_tag),
+					prefix, a.size() - prefix - suffix);
+				return;
+			}
+			if constexpr (std::is_same_v<T, NBT_Value>) {
+				for (size_t i = prefix; i < n; i++) {
+					_path.emplace_back(static_cast<Int>(i));
+					value(a[i], b[i]);
+					_path.pop_back();
+				}
+			}
+			else {
+				for (size_t i = prefix; i < n;) {
+					size_t end = i + 1;
+					for (size_t j = end; j < n && j - end <= merge_gap; j++)
+						if (!(a[j] == b[j]))
+							end = j + 1;
+					emit(op_kind::splice, slice(b.subspan(i, end - i), element_tag), i, end - i);
+					for (i = end; i < n && a[i] == b[i]; i++);
+				}
+			}
+		}
+
+		void list(const List& a, const List& b, const NBT_Value& whole) {
+			if (a.element_tag() != b.element_tag()) {
+				emit(op_kind::set, whole);
+				return;
+			}
+			if (a._elements.index() != b._elements.index()) {
+				// one side was indexed through operator[]; compare as nodes
+				List n1 = a, n2 = b;
+				n1.nodes();
+				n2.nodes();
+				list(n1, n2, whole);
+				return;
+			}
+			std::visit([&](const auto& elements) {
+				using V = std::decay_t<decltype(elements)>;
+				using T = typename V::value_type;
+				sequence<T>(elements, std::get<V>(b._elements), a.element_tag());
+				}, a._elements);
+		}
+
+		void compound(const Compound& a, const Compound& b) {
+			for (const auto& [key, _] : a) {
+				if (!b.contains(key)) {
+					_path.emplace_back(String(key.view()));
+					emit(op_kind::remove);
+					_path.pop_back();
+				}
+			}
+			for (const auto& [key, v] : b) {
+				_path.emplace_back(String(key.view()));
+				auto it = a.find(key);
+				if (it == a.end())
+					emit(op_kind::set, v);
+				else
+					value(it->second, v);
+				_path.pop_back();
+			}
+		}
+
+	public:
+		explicit differ(std::vector<operation>& operations) :_operations(operations) {}
+
+		void value(const NBT_Value& a, const NBT_Value& b) {
+			// copies still sharing a subtree (use_cow)
+			if (&a.resolved() == &b.resolved())
+				return;
+			if (a.get_tag() != b.get_tag()) {
+				emit(op_kind::set, b);
+				return;
+			}
+			std::visit([&](const auto& x) {
+				using T = std::decay_t<decltype(x)>;
+				const auto& y = std::get<T>(b.payload());
+				if constexpr (std::is_same_v<T, Compound>)
+					compound(x, y);
+				else if constexpr (std::is_same_v<T, List>)
+					list(x, y, b);
+				else if constexpr (std::is_same_v<T, Byte_Array> || std::is_same_v<T, Int_Array> || std::is_same_v<T, Long_Array>)
+					sequence<typename T::value_type>(x, y, NBT_Tag::TAG_End);
+				else if (!(x == y))
+					emit(op_kind::set, b);
+				}, a.payload());
+		}
+	};
+
+	NBT_Patch NBT_Patch::diff(const NBT_Value& base, const NBT_Value& target)
+	{
+		NBT_Patch patch;
+		differ(patch._operations).value(base, target);
+		return patch;
+	}
+
+	NBT_Value& NBT_Patch::resolve(NBT_Value& root, const NBT_Path& path, size_t depth)
+	{
+		auto v = &root;
+		for (size_t i = 0; i < depth; i++) {
+			v->unshare();
+			v->reset_hash();
+			if (auto key = std::get_if<String>(&path[i])) {
+				auto cmp = std::get_if<Compound>(&v->_value);
+				if (!cmp)
+					bad_patch("no Compound to look up " + *key + " in");
+				auto it = cmp->find(*key);
+				if (it == cmp->end())
+					bad_patch("no tag named " + *key);
+				v = &it->second;
+			}
+			else {
+				auto index = std::get<Int>(path[i]);
+				auto list = std::get_if<List>(&v->_value);
+				if (!list)
+					bad_patch("no List to index");
+				if (index < 0 || static_cast<size_t>(index) >= list->size())
+					bad_patch("List index " + std::to_string(index) + " out of range");
+				v = &list->nodes()[index];
+			}
+		}
+		v->unshare();
+		v->reset_hash();
+		return *v;
+	}
+
+	void NBT_Patch::apply_splice(NBT_Value& target, const operation& op)
+	{
+		auto splice = [&](auto& dst, const auto& src) {
+			if (op.offset < 0 || op.count < 0 || static_cast<size_t>(op.offset) + op.count > dst.size())
+				bad_patch("splice out of range");
+			auto at = dst.erase(dst.begin() + op.offset, dst.begin() + op.offset + op.count);
+			dst.insert(at, src.begin(), src.end());
+		};
+		std::visit([&](auto& dst) {
+			using T = std::decay_t<decltype(dst)>;
+			if constexpr (std::is_same_v<T, Byte_Array> || std::is_same_v<T, Int_Array> || std::is_same_v<T, Long_Array>) {
+				auto src = std::get_if<T>(&op.value.payload());
+				if (!src)
+					bad_patch("splice of " + NBT_Value::tag_string(op.value.get_tag()) + " into " + NBT_Value::tag_string(target.get_tag()));
+				splice(dst, *src);
+			}
+			else if constexpr (std::is_same_v<T, List>) {
+				auto src = std::get_if<List>(&op.value.payload());
+				if (!src || (!src->empty() && src->element_tag() != dst.element_tag()))
+					bad_patch("splice of a List of " + NBT_Value::tag_string(src ? src->element_tag() : op.value.get_tag())
+						+ " into a List of " + NBT_Value::tag_string(dst.element_tag()));
+				List nodes;
+				if (src->_elements.index() != dst._elements.index()) {
+					dst.nodes();
+					nodes = *src;
+					nodes.nodes();
+					src = &nodes;
+				}
+				std::visit([&](auto& elements) {
+					using V = std::decay_t<decltype(elements)>;
+					splice(elements, std::get<V>(src->_elements));
+					if constexpr (std::is_same_v<typename V::value_type, NBT_Value>) {
+						for (auto i = op.offset; i < op.offset + static_cast<Int>(src->size()); i++)
+							elements[i].set_should_be_tag(dst._element_tag);
+					}
+					}, dst._elements);
+			}
+			else
+				bad_patch("splice into " + NBT_Value::tag_string(target.get_tag()));
+			}, target._value);
+	}
+
+	void NBT_Patch::apply(NBT_Value& base) const
+	{
+		for (const auto& op : _operations) {
+			switch (op.kind)
+			{
+			case op_kind::set: {
+				if (op.path.empty()) {
+					base = op.value;
+					break;
+				}
+				auto& parent = resolve(base, op.path, op.path.size() - 1);
+				if (auto key = std::get_if<String>(&op.path.back())) {
+					auto cmp = std::get_if<Compound>(&parent._value);
+					if (!cmp)
+						bad_patch("no Compound to set " + *key + " in");
+					cmp->insert_or_assign(NBT_Key(*key), op.value);
+				}
+				else {
+					auto& node = resolve(parent, { op.path.back() }, 1);
+					node = op.value;
+					node.set_should_be_tag(node.get_tag());
+				}
+				break;
+			}
+			case op_kind::remove: {
+				auto key = op.path.empty() ? nullptr : std::get_if<String>(&op.path.back());
+				if (!key)
+					bad_patch("remove without a key");
+				auto& parent = resolve(base, op.path, op.path.size() - 1);
+				auto cmp = std::get_if<Compound>(&parent._value);
+				if (!cmp || cmp->erase(*key) == 0)
+					bad_patch("no tag named " + *key + " to remove");
+				break;
+			}
+			case op_kind::splice:
+				apply_splice(resolve(base, op.path, op.path.size()), op);
+				break;
+			default:
+				bad_patch("unknown operation " + std::to_string((int)op.kind));
+			}
+		}
+	}
+
+	// Layout, big-endian like NBT itself:
+	//   "NBTP" version:u8 count:Int
+	//   per operation: kind:u8 depth:u16 steps value
+	//   step: TAG_String name:string | TAG_Int index:Int
+	//   set: tag:u8 payload; remove: nothing; splice: offset:Int count:Int tag:u8 payload
+	size_t NBT_Patch::serialized_size() const
+	{
+		size_t n = sizeof(patch_magic) + 1 + sizeof(Int);
+		for (const auto& op : _operations) {
+			n += 1 + sizeof(uint16_t);
+			for (const auto& step : op.path) {
+				auto key = std::get_if<String>(&step);
+				n += 1 + (key ? sizeof(uint16_t) + key->size() : sizeof(Int));
+			}
+			if (op.kind == op_kind::splice)
+				n += 2 * sizeof(Int);
+			if (op.kind != op_kind::remove)
+				n += 1 + NBT_Value::binary_size(op.value);
+		}
+		return n;
+	}
+
+	void NBT_Patch::write(NBT_Writer& out) const
+	{
+		out.write_bytes(patch_magic, sizeof(patch_magic));
+		out.write(patch_version);
+		out.write(static_cast<Int>(_operations.size()));
+		for (const auto& op : _operations) {
+			out.write(static_cast<uint8_t>(op.kind));
+			out.write(static_cast<uint16_t>(op.path.size()));
+			for (const auto& step : op.path) {
+				if (auto key = std::get_if<String>(&step)) {
+					out.write(static_cast<uint8_t>(NBT_Tag::TAG_String));
+					out.write_string(*key);
+				}
+				else {
+					out.write(static_cast<uint8_t>(NBT_Tag::TAG_Int));
+					out.write(std::get<Int>(step));
+				}
+			}
+			if (op.kind == op_kind::splice) {
+				out.write(op.offset);
+				out.write(op.count);
+			}
+			if (op.kind != op_kind::remove) {
+				out.write(static_cast<uint8_t>(op.value.get_tag()));
+				NBT_Value::put_binary_data(out, op.value);
+			}
+		}
+	}
+
+	std::vector<std::byte> NBT_Patch::to_binary() const
+	{
+		std::vector<std::byte> buffer(serialized_size());
+		NBT_Writer writer(buffer);
+		write(writer);
+		return buffer;
+	}
+
+	NBT_Value NBT_Patch::read_value(NBT_Reader& in)
+	{
+		NBT_Value::binary_context ctx;
+		switch (NBT_Value::get_binary_tag(in))
+		{
+		case NBT_Tag::TAG_End:			return NBT_Value();
+		case NBT_Tag::TAG_Byte:			return NBT_Value(NBT_Value::get_binary_byte(in));
+		case NBT_Tag::TAG_Short:		return NBT_Value(NBT_Value::get_binary_short(in));
+		case NBT_Tag::TAG_Int:			return NBT_Value(NBT_Value::get_binary_int(in));
+		case NBT_Tag::TAG_Long:			return NBT_Value(NBT_Value::get_binary_long(in));
+		case NBT_Tag::TAG_Float:		return NBT_Value(NBT_Value::get_binary_float(in));
+		case NBT_Tag::TAG_Double:		return NBT_Value(NBT_Value::get_binary_double(in));
+		case NBT_Tag::TAG_Byte_Array:	return NBT_Value(NBT_Value::get_binary_byte_array(in, ctx));
+		case NBT_Tag::TAG_String:		return NBT_Value(NBT_Value::get_binary_string(in));
+		case NBT_Tag::TAG_List:			return NBT_Value(NBT_Value::get_binary_list(in, ctx));
+		case NBT_Tag::TAG_Compound:		return NBT_Value(NBT_Value::get_binary_compound(in, ctx));
+		case NBT_Tag::TAG_Int_Array:	return NBT_Value(NBT_Value::get_binary_int_array(in, ctx));
+		case NBT_Tag::TAG_Long_Array:	return NBT_Value(NBT_Value::get_binary_long_array(in, ctx));
+		default:
+			bad_patch("unknown value tag");
+		}
+	}
+
+	NBT_Patch NBT_Patch::read(NBT_Reader& in)
+	{
+		char magic[sizeof(patch_magic)];
+		in.read_into(magic, sizeof(magic));
+		if (std::memcmp(magic, patch_magic, sizeof(magic)) != 0)
+			bad_patch("not a patch");
+		if (auto version = in.read<uint8_t>(); version != patch_version)
+			bad_patch("unsupported version " + std::to_string(version));
+		NBT_Patch patch;
+		// kind and path depth at least
+		auto count = NBT_Value::get_binary_length(in, 3);
+		patch._operations.reserve(std::min<size_t>(count, in.remaining()));
+		for (Int i = 0; i < count; i++) {
+			operation op;
+			op.kind = static_cast<op_kind>(in.read<uint8_t>());
+			if (op.kind != op_kind::set && op.kind != op_kind::remove && op.kind != op_kind::splice)
+				bad_patch("unknown operation " + std::to_string((int)op.kind));
+			auto depth = in.read<uint16_t>();
+			op.path.reserve(depth);
+			for (; depth > 0; depth--) {
+				switch (NBT_Value::get_binary_tag(in))
+				{
+				case NBT_Tag::TAG_String:	op.path.emplace_back(in.read_string()); break;
+				case NBT_Tag::TAG_Int:		op.path.emplace_back(in.read<Int>()); break;
+				default:
+					bad_patch("bad path step");
+				}
+			}
+			if (op.kind == op_kind::splice) {
+				op.offset = in.read<Int>();
+				op.count = in.read<Int>();
+			}
+			if (op.kind != op_kind::remove)
+				op.value = read_value(in);
+			patch._operations.push_back(std::move(op));
+		}
+		return patch;
+	}
+
+	NBT_Patch NBT_Patch::from_binary(std::span<const std::byte> bytes)
+	{
+		NBT_Reader in(bytes);
+		return read(in);
+	}
+
+}
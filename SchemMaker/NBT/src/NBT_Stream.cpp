@@ -0,0 +1,262 @@
+#include "NBT_Stream.h"
+
+#include <algorithm>
+#include <limits>
+#include <string>
+#include <thread>
+
+namespace NBT {
+
+	size_t NBT_IstreamSource::pull(std::byte* dst, size_t n)
+	{
+		_in.read(reinterpret_cast<char*>(dst), static_cast<std::streamsize>(n));
+		return static_cast<size_t>(_in.gcount());
+	}
+
+	void NBT_InflateSource::init()
+	{
+		// 32 + MAX_WBITS: accept both gzip and zlib headers
+		if (inflateInit2(&_strm, 32 + MAX_WBITS) != Z_OK)
+			throw NBT_Exception("Bad Read: inflateInit2 failed");
+	}
+
+	NBT_InflateSource::NBT_InflateSource(std::istream& in, size_t buffer_size) :
+		_in(&in), _in_buffer(new Bytef[buffer_size]), _in_buffer_size(buffer_size)
+	{
+		init();
+	}
+
+	NBT_InflateSource::NBT_InflateSource(std::span<const std::byte> compressed) :
+		_in_span(compressed)
+	{
+		init();
+	}
+
+	NBT_InflateSource::~NBT_InflateSource()
+	{
+		inflateEnd(&_strm);
+	}
+
+	size_t NBT_InflateSource::pull(std::byte* dst, size_t n)
+	{
+		if (_finished)
+			return 0;
+		n = std::min<size_t>(n, std::numeric_limits<uInt>::max());
+		_strm.next_out = reinterpret_cast<Bytef*>(dst);
+		_strm.avail_out = static_cast<uInt>(n);
+		while (_strm.avail_out > 0) {
+			if (_strm.avail_in == 0 && _in) {
+				_in->read(reinterpret_cast<char*>(_in_buffer.get()), static_cast<std::streamsize>(_in_buffer_size));
+				_strm.next_in = _in_buffer.get();
+				_strm.avail_in = static_cast<uInt>(_in->gcount());
+			}
+			else if (_strm.avail_in == 0 && !_in_span.empty()) {
+				auto step = std::min<size_t>(_in_span.size(), std::numeric_limits<uInt>::max());
+				_strm.next_in = reinterpret_cast<Bytef*>(const_cast<std::byte*>(_in_span.data()));
+				_strm.avail_in = static_cast<uInt>(step);
+				_in_span = _in_span.subspan(step);
+			}
+			int ret = inflate(&_strm, Z_NO_FLUSH);
+			if (ret == Z_STREAM_END) {
+				_finished = true;
+				break;
+			}
+			if (ret == Z_BUF_ERROR && _strm.avail_in == 0)
+				break;
+			if (ret != Z_OK)
+				throw NBT_Exception(std::string("Bad Read: inflate failed: ") + (_strm.msg ? _strm.msg : std::to_string(ret)));
+		}
+		return n - _strm.avail_out;
+	}
+
+	void NBT_OstreamSink::push(const std::byte* data, size_t n)
+	{
+		_out.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(n));
+		if (!_out)
+			throw NBT_Exception("Bad Write: stream error");
+	}
+
+	NBT_DeflateSink::NBT_DeflateSink(std::ostream& out, NBT_Framing framing, const NBT_DeflateOptions& options,
+		size_t buffer_size) :
+		_out(out), _out_buffer(new Bytef[buffer_size]), _out_buffer_size(buffer_size)
+	{
+		// 16 + MAX_WBITS: gzip header and trailer instead of zlib's
+		int window_bits = framing == NBT_Framing::gzip ? 16 + MAX_WBITS : MAX_WBITS;
+		if (deflateInit2(&_strm, options.level, Z_DEFLATED, window_bits, 8, options.strategy) != Z_OK)
+			throw NBT_Exception("Bad Write: deflateInit2 failed, level " + std::to_string(options.level)
+				+ " strategy " + std::to_string(options.strategy));
+	}
+
+	NBT_DeflateSink::~NBT_DeflateSink()
+	{
+		deflateEnd(&_strm);
+	}
+
+	void NBT_DeflateSink::deflate_buffer(int flush)
+	{
+		int ret;
+		do {
+			_strm.next_out = _out_buffer.get();
+			_strm.avail_out = static_cast<uInt>(_out_buffer_size);
+			ret = deflate(&_strm, flush);
+			if (ret == Z_STREAM_ERROR)
+				throw NBT_Exception("Bad Write: deflate failed");
+			_out.write(reinterpret_cast<const char*>(_out_buffer.get()),
+				static_cast<std::streamsize>(_out_buffer_size - _strm.avail_out));
+			if (!_out)
+				throw NBT_Exception("Bad Write: stream error");
+		} while (_strm.avail_out == 0 || (flush == Z_FINISH && ret != Z_STREAM_END));
+	}
+
+	void NBT_DeflateSink::push(const std::byte* data, size_t n)
+	{
+		while (n > 0) {
+			auto step = std::min<size_t>(n, std::numeric_limits<uInt>::max());
+			_strm.next_in = reinterpret_cast<Bytef*>(const_cast<std::byte*>(data));
+			_strm.avail_in = static_cast<uInt>(step);
+			deflate_buffer(Z_NO_FLUSH);
+			data += step;
+			n -= step;
+		}
+	}
+
+	void NBT_DeflateSink::finish()
+	{
+		_strm.next_in = nullptr;
+		_strm.avail_in = 0;
+		deflate_buffer(Z_FINISH);
+	}
+
+	NBT_ParallelDeflateSink::NBT_ParallelDeflateSink(std::ostream& out, NBT_Framing framing, const NBT_DeflateOptions& options) :
+		_out(out), _framing(framing), _options(options)
+	{
+		_threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+		// blocks must overlap by at least the dictionary size to be worth it
+		_options.block_size = std::max<size_t>(options.block_size, 32 * 1024);
+		// reject bad settings here rather than from a worker
+		z_stream probe{};
+		if (deflateInit2(&probe, options.level, Z_DEFLATED, -MAX_WBITS, 8, options.strategy) != Z_OK)
+			throw NBT_Exception("Bad Write: deflateInit2 failed, level " + std::to_string(options.level)
+				+ " strategy " + std::to_string(options.strategy));
+		deflateEnd(&probe);
+		_current.reserve(_options.block_size);
+
+		if (framing == NBT_Framing::gzip) {
+			// no name, no mtime, OS unknown
+			const Bytef header[10] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff };
+			write_bytes(header, sizeof(header));
+			_check = crc32(0, nullptr, 0);
+		}
+		else {
+			int level = options.level == Z_DEFAULT_COMPRESSION ? 6 : options.level;
+			unsigned level_flags = options.strategy >= Z_HUFFMAN_ONLY || level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3;
+			unsigned header = ((Z_DEFLATED + ((MAX_WBITS - 8) << 4)) << 8) | (level_flags << 6);
+			header += 31 - header % 31;
+			const Bytef bytes[2] = { static_cast<Bytef>(header >> 8), static_cast<Bytef>(header) };
+			write_bytes(bytes, sizeof(bytes));
+			_check = adler32(0, nullptr, 0);
+		}
+	}
+
+	NBT_ParallelDeflateSink::compressed_block NBT_ParallelDeflateSink::compress(block input, block dictionary, bool last,
+		NBT_Framing framing, const NBT_DeflateOptions& options)
+	{
+		compressed_block v{ {}, 0, input->size() };
+		z_stream strm{};
+		// negative window bits: raw deflate, the framing is written by the sink
+		if (deflateInit2(&strm, options.level, Z_DEFLATED, -MAX_WBITS, 8, options.strategy) != Z_OK)
+			throw NBT_Exception("Bad Write: deflateInit2 failed");
+		if (dictionary) {
+			auto n = std::min<size_t>(dictionary->size(), 32 * 1024);
+			deflateSetDictionary(&strm, dictionary->data() + dictionary->size() - n, static_cast<uInt>(n));
+		}
+		// room for the sync flush marker on top of the bound
+		v.data.resize(deflateBound(&strm, static_cast<uLong>(input->size())) + 16);
+		strm.next_in = const_cast<Bytef*>(input->data());
+		strm.avail_in = static_cast<uInt>(input->size());
+		// a sync flush ends on a byte boundary, so blocks can be concatenated
+		int flush = last ? Z_FINISH : Z_SYNC_FLUSH;
+		int ret;
+		do {
+			if (strm.total_out == v.data.size())
+				v.data.resize(v.data.size() * 2);
+			strm.next_out = v.data.data() + strm.total_out;
+			strm.avail_out = static_cast<uInt>(v.data.size() - strm.total_out);
+			ret = deflate(&strm, flush);
+		} while (ret != Z_STREAM_ERROR && (strm.avail_out == 0 || (last && ret != Z_STREAM_END)));
+		v.data.resize(strm.total_out);
+		deflateEnd(&strm);
+		if (ret == Z_STREAM_ERROR)
+			throw NBT_Exception("Bad Write: deflate failed");
+
+		v.check = framing == NBT_Framing::gzip
+			? crc32(0, input->data(), static_cast<uInt>(input->size()))
+			: adler32(1, input->data(), static_cast<uInt>(input->size()));
+		return v;
+	}
+
+	void NBT_ParallelDeflateSink::dispatch(bool last)
+	{
+		auto input = std::make_shared<const std::vector<Bytef>>(std::move(_current));
+		_current = {};
+		_current.reserve(_options.block_size);
+		if (_pending.size() >= _threads)
+			write_front();
+		_pending.push_back(std::async(std::launch::async, compress, input, _previous, last, _framing, _options));
+		_previous = std::move(input);
+	}
+
+	void NBT_ParallelDeflateSink::write_front()
+	{
+		auto v = _pending.front().get();
+		_pending.pop_front();
+		write_bytes(v.data.data(), v.data.size());
+		_check = _framing == NBT_Framing::gzip
+			? crc32_combine(_check, v.check, static_cast<z_off_t>(v.size))
+			: adler32_combine(_check, v.check, static_cast<z_off_t>(v.size));
+		_total += static_cast<uLong>(v.size);
+	}
+
+	void NBT_ParallelDeflateSink::write_bytes(const void* data, size_t n)
+	{
+		_out.write(static_cast<const char*>(data), static_cast<std::streamsize>(n));
+		if (!_out)
+			throw NBT_Exception("Bad Write: stream error");
+	}
+
+	void NBT_ParallelDeflateSink::push(const std::byte* data, size_t n)
+	{
+		auto bytes = reinterpret_cast<const Bytef*>(data);
+		while (n > 0) {
+			auto step = std::min(n, _options.block_size - _current.size());
+			_current.insert(_current.end(), bytes, bytes + step);
+			bytes += step;
+			n -= step;
+			if (_current.size() == _options.block_size)
+				dispatch(false);
+		}
+	}
+
+	void NBT_ParallelDeflateSink::finish()
+	{
+		dispatch(true);
+		while (!_pending.empty())
+			write_front();
+
+		Bytef trailer[8];
+		if (_framing == NBT_Framing::gzip) {
+			// CRC-32 and length mod 2^32, little-endian
+			for (int i = 0; i < 4; i++) {
+				trailer[i] = static_cast<Bytef>(_check >> (8 * i));
+				trailer[4 + i] = static_cast<Bytef>(_total >> (8 * i));
+			}
+			write_bytes(trailer, 8);
+		}
+		else {
+			for (int i = 0; i < 4; i++)
+				trailer[i] = static_cast<Bytef>(_check >> (24 - 8 * i));
+			write_bytes(trailer, 4);
+		}
+	}
+
+}
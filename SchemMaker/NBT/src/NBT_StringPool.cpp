@@ -0,0 +1,44 @@
+#include "NBT_StringPool.h"
+
+namespace NBT {
+
+	void NBT_StringPool::grow()
+	{
+		std::vector<const char*> slots(_slots.size() * 2, nullptr);
+		auto mask = slots.size() - 1;
+		for (auto p : _slots) {
+			if (!p)
+				continue;
+			auto i = header_of(p).hash & mask;
+			while (slots[i])
+				i = (i + 1) & mask;
+			slots[i] = p;
+		}
+		_slots = std::move(slots);
+	}
+
+	NBT_Key NBT_StringPool::intern(std::string_view s)
+	{
+		auto hash = std::hash<std::string_view>{}(s);
+		auto mask = _slots.size() - 1;
+		auto i = hash & mask;
+		for (; _slots[i]; i = (i + 1) & mask) {
+			auto& h = header_of(_slots[i]);
+			if (h.hash == hash && std::string_view(_slots[i], h.size) == s)
+				return NBT_Key(_slots[i], h.size, NBT_Key::interned_tag{});
+		}
+
+		auto block = static_cast<char*>(_arena.allocate(sizeof(header) + s.size(), alignof(header)));
+		new (block) header{ hash, s.size() };
+		auto p = block + sizeof(header);
+		std::memcpy(p, s.data(), s.size());
+		_slots[i] = p;
+		_count++;
+		_bytes += s.size();
+		// keep the load factor at or below one half
+		if (_count * 2 > _slots.size())
+			grow();
+		return NBT_Key(p, s.size(), NBT_Key::interned_tag{});
+	}
+
+}
@@ -1,118 +1,569 @@
 #include "NBT_Value.h"
+#include "NBT_Stream.h"
+#include "NBT_MappedFile.h"
 
+#include <charconv>
+#include <cmath>
+#include <cstdio>
 #include <functional>
 #include <string>
 #include <algorithm>
 
 namespace NBT {
 
-	std::partial_ordering NBT::operator<=>(const NBT_Value& v1, const NBT_Value& v2) { return v1._value <=> v2._value; }
-	auto NBT::operator==(const NBT_Value& v1, const NBT_Value& v2) { return v1._value == v2._value; }
+	std::partial_ordering operator<=>(const NBT_Value& v1, const NBT_Value& v2) {
+		return v1.payload() <=> v2.payload();
+	}
+	bool operator==(const NBT_Value& v1, const NBT_Value& v2) {
+		// copies sharing one payload
+		auto& r1 = v1.resolved();
+		auto& r2 = v2.resolved();
+		if (&r1 == &r2)
+			return true;
+		// Hashes cached on shared payloads are current, as those never change.
+		if (&r1 != &v1 && &r2 != &v2) {
+			auto h1 = std::atomic_ref<uint32_t>(r1._hash).load(std::memory_order_relaxed);
+			auto h2 = std::atomic_ref<uint32_t>(r2._hash).load(std::memory_order_relaxed);
+			if (h1 && h2 && h1 != h2)
+				return false;
+		}
+		return v1.payload() == v2.payload();
+	}
+
+	NBT_List::NBT_List(NBT_Tag element_tag, std::pmr::memory_resource* resource) :
+		_elements(std::in_place_index<0>, resource), _element_tag(element_tag)
+	{
+		switch (element_tag)
+		{
+		case NBT_Tag::TAG_Byte:		_elements.emplace<1>(resource); break;
+		case NBT_Tag::TAG_Short:	_elements.emplace<2>(resource); break;
+		case NBT_Tag::TAG_Int:		_elements.emplace<3>(resource); break;
+		case NBT_Tag::TAG_Long:		_elements.emplace<4>(resource); break;
+		case NBT_Tag::TAG_Float:	_elements.emplace<5>(resource); break;
+		case NBT_Tag::TAG_Double:	_elements.emplace<6>(resource); break;
+		default:
+			break;
+		}
+	}
+
+	void NBT_List::push_back(NBT_Value v)
+	{
+		auto t = v.get_tag();
+		if (empty() && _element_tag == NBT_Tag::TAG_End)
+			*this = NBT_List(t, resource());
+		else if (t != _element_tag)
+			throw NBT_Exception("Bad type: push " + NBT_Value::tag_string(t) + " to a List of " + NBT_Value::tag_string(_element_tag));
+		std::visit([&](auto& elements) {
+			using T = typename std::decay_t<decltype(elements)>::value_type;
+			if constexpr (std::is_same_v<T, NBT_Value>) {
+				elements.push_back(std::move(v));
+				elements.back().set_should_be_tag(_element_tag);
+			}
+			else
+				elements.push_back(v.get<T>());
+			}, _elements);
+	}
+
+	std::pmr::vector<NBT_Value>& NBT_List::nodes()
+	{
+		if (is_packed()) {
+			std::pmr::vector<NBT_Value> nodes(resource());
+			std::visit([&](const auto& elements) {
+				using T = typename std::decay_t<decltype(elements)>::value_type;
+				if constexpr (!std::is_same_v<T, NBT_Value>) {
+					nodes.reserve(elements.size());
+					for (auto v : elements)
+						nodes.emplace_back(v).set_should_be_tag(_element_tag);
+				}
+				}, _elements);
+			_elements = std::move(nodes);
+		}
+		return std::get<0>(_elements);
+	}
+
+	// A packed element compares as the node it would be unpacked into.
+	template<typename T>
+	static decltype(auto) as_node(const T& v) {
+		if constexpr (std::is_same_v<T, NBT_Value>)
+			return (v);
+		else
+			return NBT_Value(v);
+	}
+
+	std::partial_ordering operator<=>(const NBT_List& l1, const NBT_List& l2) {
+		if (l1._elements.index() == l2._elements.index())
+			return l1._elements <=> l2._elements;
+		// one side was indexed through operator[]; compare element by element
+		// as nodes, without unpacking the other
+		return std::visit([](const auto& e1, const auto& e2) {
+			return std::lexicographical_compare_three_way(e1.begin(), e1.end(), e2.begin(), e2.end(),
+				[](const auto& a, const auto& b) { return as_node(a) <=> as_node(b); });
+			}, l1._elements, l2._elements);
+	}
+	bool operator==(const NBT_List& l1, const NBT_List& l2) {
+		return (l1 <=> l2) == 0;
+	}
+
+	NBT_Compound::NBT_Compound(const NBT_Compound& v) :_entries(v._entries)
+	{
+		rebuild_index();
+	}
+
+	NBT_Compound::NBT_Compound(NBT_Compound&& v) noexcept :
+		_entries(std::move(v._entries)), _slots(v._slots), _slot_mask(v._slot_mask)
+	{
+		v._slots = nullptr;
+		v._slot_mask = 0;
+	}
+
+	NBT_Compound& NBT_Compound::operator=(const NBT_Compound& v)
+	{
+		if (this != &v) {
+			_entries = v._entries;
+			rebuild_index();
+		}
+		return *this;
+	}
+
+	NBT_Compound& NBT_Compound::operator=(NBT_Compound&& v) noexcept
+	{
+		if (this == &v)
+			return *this;
+		free_index();
+		// pmr containers only hand over their buffer within one resource
+		bool same_resource = get_allocator() == v.get_allocator();
+		_entries = std::move(v._entries);
+		if (same_resource) {
+			std::swap(_slots, v._slots);
+			std::swap(_slot_mask, v._slot_mask);
+		}
+		else
+			rebuild_index();
+		v._entries.clear();
+		v.free_index();
+		return *this;
+	}
+
+	void NBT_Compound::free_index() noexcept
+	{
+		if (_slots)
+			resource()->deallocate(_slots, (size_t(_slot_mask) + 1) * sizeof(uint32_t), alignof(uint32_t));
+		_slots = nullptr;
+		_slot_mask = 0;
+	}
+
+	void NBT_Compound::insert_slot(size_t index)
+	{
+		auto i = _entries[index].first.hash() & _slot_mask;
+		while (_slots[i] != 0)
+			i = (i + 1) & _slot_mask;
+		_slots[i] = static_cast<uint32_t>(index + 1);
+	}
+
+	void NBT_Compound::rebuild_index()
+	{
+		free_index();
+		if (_entries.size() <= linear_limit)
+			return;
+		// keep the load factor at or below one half
+		size_t capacity = 16;
+		while (capacity < _entries.size() * 2)
+			capacity *= 2;
+		_slots = static_cast<uint32_t*>(resource()->allocate(capacity * sizeof(uint32_t), alignof(uint32_t)));
+		std::fill_n(_slots, capacity, 0u);
+		_slot_mask = static_cast<uint32_t>(capacity - 1);
+		for (size_t i = 0; i < _entries.size(); i++)
+			insert_slot(i);
+	}
+
+	NBT_Compound::value_type& NBT_Compound::emplace_new(NBT_Key&& key, NBT_Value&& value)
+	{
+		_entries.emplace_back(std::move(key), std::move(value));
+		return index_back();
+	}
+
+	NBT_Compound::value_type& NBT_Compound::index_back()
+	{
+		if (_entries.size() <= linear_limit)
+			return _entries.back();
+		if (!_slots || _entries.size() * 2 > size_t(_slot_mask) + 1)
+			rebuild_index();
+		else
+			insert_slot(_entries.size() - 1);
+		return _entries.back();
+	}
+
+	size_t NBT_Compound::erase(std::string_view key)
+	{
+		auto i = find_index(key);
+		if (i == npos)
+			return 0;
+		_entries.erase(_entries.begin() + i);
+		rebuild_index();
+		return 1;
+	}
+
+	// Ordered like the std::map this replaced: entries compared by key order.
+	std::partial_ordering operator<=>(const NBT_Compound& c1, const NBT_Compound& c2) {
+		auto sorted = [](const NBT_Compound& c) {
+			std::vector<const NBT_Compound::value_type*> v;
+			v.reserve(c.size());
+			for (auto& e : c)
+				v.push_back(&e);
+			std::sort(v.begin(), v.end(), [](auto a, auto b) { return a->first < b->first; });
+			return v;
+		};
+		auto s1 = sorted(c1), s2 = sorted(c2);
+		for (size_t i = 0; i < s1.size() && i < s2.size(); i++) {
+			if (auto c = s1[i]->first <=> s2[i]->first; c != 0)
+				return c;
+			if (auto c = s1[i]->second <=> s2[i]->second; c != 0)
+				return c;
+		}
+		return s1.size() <=> s2.size();
+	}
+	bool operator==(const NBT_Compound& c1, const NBT_Compound& c2) {
+		if (c1.size() != c2.size())
+			return false;
+		for (auto& [key, value] : c1) {
+			auto it = c2.find(key);
+			if (it == c2.end() || !(it->second == value))
+				return false;
+		}
+		return true;
+	}
 
 	tag_builder operator ""_tag(const char* v, size_t n) { return tag_builder(v); }
 	NBT_Value::byte_array_visitor operator ""_B(unsigned long long v) { return { (int16_t)v }; }
 	NBT_Value::int_array_visitor operator ""_I(unsigned long long v) { return { (int16_t)v }; }
 	NBT_Value::long_array_visitor operator ""_L(unsigned long long v) { return { (int16_t)v }; }
 
-	NBT::NBT_Value::NBT_Value(std::initializer_list<std::pair<std::string, NBT_Value>> ils)
+	NBT::NBT_Value::NBT_Value(std::initializer_list<std::pair<std::string, NBT_Value>> ils) :_state(0)
 	{
+		// initializer_list elements are const: one copy each is the least possible
 		Compound cmp;
-		for (auto& pair : ils) {
-			cmp[pair.first] = pair.second;
-		}
+		cmp.reserve(ils.size());
+		for (auto& pair : ils)
+			cmp.insert_or_assign(pair.first, pair.second);
 		_value = std::move(cmp);
 	}
 
-	std::string NBT::NBT_Value::to_string() const
-	{
-		struct {
-			std::string operator()(const End v) {
-				return "";
-			};
-			std::string operator()(const Byte v) {
-				return std::to_string(v) + "B";
-			};
-			std::string operator()(const Short v) {
-				return std::to_string(v) + "S";
-			};
-			std::string operator()(const Int v) {
-				return std::to_string(v);
-			};
-			std::string operator()(const Long v) {
-				return std::to_string(v) + "L";
-			};
-			std::string operator()(const Float v) {
-				return std::to_string(v) + "F";
-			};
-			std::string operator()(const Double v) {
-				return std::to_string(v);
-			};
-			std::string operator()(const Byte_Array v) {
-				std::string r{ "[B;" };
-				if (!v.empty()) {
-					r += std::to_string(v[0]) + "B";
-					std::for_each(++v.begin(), v.end(),
-						[&r](const Byte& a) {
-							r += ",";
-							r += std::to_string(a) + "B";
-						}
-					);
+	// Appends the text forms to a string, which print(std::ostream&) drains
+	// into the stream whenever it grows past flush_size.
+	class NBT_Value::text_printer {
+	private:
+		static constexpr size_t flush_size = 64 * 1024;
+
+		std::string& _out;
+		std::ostream* _os;
+		int _depth = 0;
+
+		void flush_if_full() {
+			if (_os && _out.size() >= flush_size) {
+				_os->write(_out.data(), static_cast<std::streamsize>(_out.size()));
+				_out.clear();
+			}
+		}
+
+		template<typename T>
+		void number(T v) {
+			char buffer[32];
+			auto end = std::to_chars(buffer, buffer + sizeof(buffer), v).ptr;
+			_out.append(buffer, end);
+		}
+
+		void indent() { _out.append(2 * size_t(_depth), ' '); }
+
+		static bool is_bare_key(std::string_view s) {
+			return !s.empty() && std::all_of(s.begin(), s.end(), [](char c) {
+				return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+					|| c == '_' || c == '-' || c == '.' || c == '+';
+				});
+		}
+
+		void snbt_string(std::string_view s) {
+			_out += '"';
+			for (char c : s) {
+				if (c == '"' || c == '\\')
+					_out += '\\';
+				_out += c;
+			}
+			_out += '"';
+		}
+
+		void json_string(std::string_view s) {
+			_out += '"';
+			for (char c : s) {
+				switch (c) {
+				case '"':	_out += "\\\""; break;
+				case '\\':	_out += "\\\\"; break;
+				case '\n':	_out += "\\n"; break;
+				case '\r':	_out += "\\r"; break;
+				case '\t':	_out += "\\t"; break;
+				default:
+					if (static_cast<unsigned char>(c) < 0x20) {
+						char buffer[8];
+						std::snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+						_out += buffer;
+					}
+					else
+						_out += c;
 				}
-				return r + "]";
-			};
-			std::string operator()(const String v) {
-				return v;
-			};
-			std::string operator()(const List v) {
-				std::string r{ "[" };
-				if (!v.empty()) {
-					r += v[0].to_string();
-					std::for_each(++v.begin(), v.end(),
-						[&r](const NBT_Value& a) {
-							r += ",";
-							r += a.to_string();
+			}
+			_out += '"';
+		}
+
+		template<typename T>
+		void snbt_scalar(T v) {
+			// SNBT has no NaN or infinity either; spell them inf, -inf and nan
+			// before the suffix, as parse_snbt reads them
+			if constexpr (std::is_floating_point_v<T>) {
+				if (!std::isfinite(v))
+					_out += std::isnan(v) ? "nan" : v < 0 ? "-inf" : "inf";
+				else
+					number(v);
+			}
+			else
+				number(v);
+			if constexpr (std::is_same_v<T, Byte>)			_out += 'b';
+			else if constexpr (std::is_same_v<T, Short>)	_out += 's';
+			else if constexpr (std::is_same_v<T, Long>)		_out += 'L';
+			else if constexpr (std::is_same_v<T, Float>)	_out += 'f';
+			else if constexpr (std::is_same_v<T, Double>)	_out += 'd';
+		}
+
+		template<typename T>
+		void json_scalar(T v) {
+			if constexpr (std::is_floating_point_v<T>) {
+				// JSON has no NaN or infinity
+				if (!std::isfinite(v)) {
+					_out += "null";
+					return;
+				}
+			}
+			number(v);
+		}
+
+		template<typename T>
+		void snbt_array(std::string_view prefix, const T& v) {
+			_out += prefix;
+			for (size_t i = 0; i < v.size(); i++) {
+				if (i > 0)
+					_out += ',';
+				snbt_scalar(v[i]);
+				flush_if_full();
+			}
+			_out += ']';
+		}
+
+		template<typename T>
+		void json_array(const T& v) {
+			_out += '[';
+			for (size_t i = 0; i < v.size(); i++) {
+				if (i > 0)
+					_out += ',';
+				json_scalar(v[i]);
+				flush_if_full();
+			}
+			_out += ']';
+		}
+
+		void tree_head(tag t, std::optional<std::string_view> name) {
+			indent();
+			_out += tag_string(t);
+			if (name) {
+				_out += "('";
+				_out += *name;
+				_out += "'): ";
+			}
+			else
+				_out += "(None): ";
+		}
+
+		template<typename T>
+		void tree_scalar(tag t, std::optional<std::string_view> name, T v) {
+			tree_head(t, name);
+			number(v);
+			_out += '\n';
+		}
+
+		template<typename F>
+		void tree_block(size_t entries, F&& children) {
+			number(entries);
+			_out += " entries\n";
+			indent();
+			_out += "{\n";
+			_depth++;
+			children();
+			_depth--;
+			indent();
+			_out += "}\n";
+		}
+
+	public:
+		text_printer(std::string& out, std::ostream* os) :_out(out), _os(os) {}
+
+		void snbt(const NBT_Value& v) {
+			std::visit([this](const auto& x) {
+				using T = std::decay_t<decltype(x)>;
+				if constexpr (std::is_same_v<T, End>) {}
+				else if constexpr (std::is_arithmetic_v<T>)	snbt_scalar(x);
+				else if constexpr (std::is_same_v<T, String>)	snbt_string(x);
+				else if constexpr (std::is_same_v<T, Byte_Array>)	snbt_array("[B;", x);
+				else if constexpr (std::is_same_v<T, Int_Array>)	snbt_array("[I;", x);
+				else if constexpr (std::is_same_v<T, Long_Array>)	snbt_array("[L;", x);
+				else if constexpr (std::is_same_v<T, List>) {
+					_out += '[';
+					x.visit([this](const auto& elements) {
+						for (size_t i = 0; i < elements.size(); i++) {
+							if (i > 0)
+								_out += ',';
+							if constexpr (std::is_same_v<typename std::decay_t<decltype(elements)>::value_type, NBT_Value>)
+								snbt(elements[i]);
+							else
+								snbt_scalar(elements[i]);
+							flush_if_full();
 						}
-					);
+						});
+					_out += ']';
 				}
-				return r + "]";
-			};
-			std::string operator()(const Compound v) {
-				std::string r{ "{" };
-				r += (*v.begin()).first + ":";
-				r += (*v.begin()).second.to_string();
-				std::for_each(++v.begin(), v.end(),
-					[&r](const std::pair<std::string, NBT_Value>& a) {
-						r += ",\n";
-						r += a.first + ":";
-						r += a.second.to_string();
-					}
-				);
-				return r + "}";
-			};
-			std::string operator()(const Int_Array v) {
-				std::string r{ "[I;" };
-				r += std::to_string(v[0]);
-				std::for_each(++v.begin(), v.end(),
-					[&r](const Int& a) {
-						r += ",";
-						r += std::to_string(a);
+				else if constexpr (std::is_same_v<T, Compound>) {
+					_out += '{';
+					bool first = true;
+					for (const auto& [key, value] : x) {
+						if (!first)
+							_out += ',';
+						first = false;
+						if (is_bare_key(key))
+							_out += key.view();
+						else
+							snbt_string(key);
+						_out += ':';
+						snbt(value);
+						flush_if_full();
 					}
-				);
-				return r + "]";
-			};
-			std::string operator()(const Long_Array v) {
-				std::string r{ "[L;" };
-				r += std::to_string(v[0]) + "L";
-				std::for_each(++v.begin(), v.end(),
-					[&r](const Long& a) {
-						r += ",";
-						r += std::to_string(a) + "L";
+					_out += '}';
+				}
+				}, v.payload());
+		}
+
+		void json(const NBT_Value& v) {
+			std::visit([this](const auto& x) {
+				using T = std::decay_t<decltype(x)>;
+				if constexpr (std::is_same_v<T, End>)			_out += "null";
+				else if constexpr (std::is_arithmetic_v<T>)	json_scalar(x);
+				else if constexpr (std::is_same_v<T, String>)	json_string(x);
+				else if constexpr (std::is_same_v<T, Byte_Array> || std::is_same_v<T, Int_Array> || std::is_same_v<T, Long_Array>)
+					json_array(x);
+				else if constexpr (std::is_same_v<T, List>) {
+					_out += '[';
+					x.visit([this](const auto& elements) {
+						for (size_t i = 0; i < elements.size(); i++) {
+							if (i > 0)
+								_out += ',';
+							if constexpr (std::is_same_v<typename std::decay_t<decltype(elements)>::value_type, NBT_Value>)
+								json(elements[i]);
+							else
+								json_scalar(elements[i]);
+							flush_if_full();
+						}
+						});
+					_out += ']';
+				}
+				else if constexpr (std::is_same_v<T, Compound>) {
+					_out += '{';
+					bool first = true;
+					for (const auto& [key, value] : x) {
+						if (!first)
+							_out += ',';
+						first = false;
+						json_string(key);
+						_out += ':';
+						json(value);
+						flush_if_full();
 					}
-				);
-				return r + "]";
-			};
-		}str_make_visitor;
-		return std::visit(str_make_visitor, _value);
+					_out += '}';
+				}
+				}, v.payload());
+		}
+
+		// Notch's indented format; arrays are summarised by their length.
+		void tree(const NBT_Value& v, std::optional<std::string_view> name) {
+			auto t = v.get_tag();
+			std::visit([&](const auto& x) {
+				using T = std::decay_t<decltype(x)>;
+				if constexpr (std::is_same_v<T, End>) {
+					indent();
+					_out += "TAG_End\n";
+				}
+				else if constexpr (std::is_arithmetic_v<T>)	tree_scalar(t, name, x);
+				else if constexpr (std::is_same_v<T, String>) {
+					tree_head(t, name);
+					_out += x;
+					_out += '\n';
+				}
+				else if constexpr (std::is_same_v<T, Byte_Array> || std::is_same_v<T, Int_Array> || std::is_same_v<T, Long_Array>) {
+					tree_head(t, name);
+					_out += '[';
+					number(x.size());
+					_out += std::is_same_v<T, Byte_Array> ? " bytes]\n" : std::is_same_v<T, Int_Array> ? " ints]\n" : " longs]\n";
+				}
+				else if constexpr (std::is_same_v<T, List>) {
+					tree_head(t, name);
+					tree_block(x.size(), [&] {
+						x.visit([&](const auto& elements) {
+							for (auto& e : elements) {
+								if constexpr (std::is_same_v<typename std::decay_t<decltype(elements)>::value_type, NBT_Value>)
+									tree(e, std::nullopt);
+								else
+									tree_scalar(x.element_tag(), std::nullopt, e);
+								flush_if_full();
+							}
+							});
+						});
+				}
+				else if constexpr (std::is_same_v<T, Compound>) {
+					tree_head(t, name);
+					tree_block(x.size(), [&] {
+						for (const auto& [key, value] : x) {
+							tree(value, key.view());
+							flush_if_full();
+						}
+						});
+				}
+				}, v.payload());
+		}
+
+		void print(const NBT_Value& v, int format) {
+			if (format & json_str)
+				json(v);
+			else if (format & tree_str)
+				tree(v, std::nullopt);
+			else
+				snbt(v);
+			if (_os) {
+				_os->write(_out.data(), static_cast<std::streamsize>(_out.size()));
+				_out.clear();
+			}
+		}
+	};
+
+	void NBT_Value::print(std::string& out, int format) const
+	{
+		text_printer(out, nullptr).print(*this, format ? format : _state);
+	}
+
+	void NBT_Value::print(std::ostream& os, int format) const
+	{
+		std::string buffer;
+		text_printer(buffer, &os).print(*this, format ? format : _state);
+	}
+
+	std::string NBT_Value::to_string(int format) const
+	{
+		std::string r;
+		print(r, format);
+		return r;
 	}
 
 	std::string NBT_Value::tag_string(tag t)
@@ -136,57 +587,283 @@ namespace NBT {
 	}
 
 	NBT_Value::tag NBT_Value::get_tag() const {
-		struct {
-			tag operator()(End			) { return tag::TAG_End;		}
-			tag operator()(Byte			) { return tag::TAG_Byte;		}
-			tag operator()(Short		) { return tag::TAG_Short;		}
-			tag operator()(Int			) { return tag::TAG_Int;		}
-			tag operator()(Long			) { return tag::TAG_Long;		}
-			tag operator()(Float		) { return tag::TAG_Float;		}
-			tag operator()(Double		) { return tag::TAG_Double;		}
-			tag operator()(Byte_Array	) { return tag::TAG_Byte_Array; }
-			tag operator()(String		) { return tag::TAG_String;		}
-			tag operator()(List			) { return tag::TAG_List;		}
-			tag operator()(Compound		) { return tag::TAG_Compound;	}
-			tag operator()(Int_Array	) { return tag::TAG_Int_Array;	}
-			tag operator()(Long_Array	) { return tag::TAG_Long_Array; }
-		}get_tag_visitor;
-		return std::visit(get_tag_visitor, _value);
+		// The variant alternatives are declared in tag order.
+		auto& v = resolved();
+		if (v._value.index() == lazy_index)
+			return std::get<Lazy>(v._value)->type;
+		return static_cast<tag>(v._value.index());
 	}
 
 	NBT_Value::tag NBT_Value::get_element_tag() const {
 		struct {
 			tag current_tag;
-			tag operator()(End			) { return current_tag;			}
-			tag operator()(Byte			) { return current_tag;			}
-			tag operator()(Short		) { return current_tag;			}
-			tag operator()(Int			) { return current_tag;			}
-			tag operator()(Long			) { return current_tag;			}
-			tag operator()(Float		) { return current_tag;			}
-			tag operator()(Double		) { return current_tag;			}
-			tag operator()(Byte_Array	) { return tag::TAG_Byte;		}
-			tag operator()(String		) { return tag::TAG_String;		}
-			tag operator()(List	l		) {
-				return l.empty() ? current_tag : l[0].get_tag();
+			tag operator()(const End&		) { return current_tag;			}
+			tag operator()(const Byte&		) { return current_tag;			}
+			tag operator()(const Short&		) { return current_tag;			}
+			tag operator()(const Int&		) { return current_tag;			}
+			tag operator()(const Long&		) { return current_tag;			}
+			tag operator()(const Float&		) { return current_tag;			}
+			tag operator()(const Double&	) { return current_tag;			}
+			tag operator()(const Byte_Array&) { return tag::TAG_Byte;		}
+			tag operator()(const String&	) { return tag::TAG_String;		}
+			tag operator()(const List& l) {
+				return l.empty() ? current_tag : l.element_tag();
 			}
-			tag operator()(Compound		) { return tag::TAG_Compound;	}
-			tag operator()(Int_Array	) { return tag::TAG_Int;		}
-			tag operator()(Long_Array	) { return tag::TAG_Long;		}
+			tag operator()(const Compound&	) { return tag::TAG_Compound;	}
+			tag operator()(const Int_Array&	) { return tag::TAG_Int;		}
+			tag operator()(const Long_Array&) { return tag::TAG_Long;		}
+			tag operator()(const Lazy&		) { return current_tag;			}
+			tag operator()(const Shared&	) { return current_tag;			}
 		}get_tag_visitor{ get_tag() };
-		return std::visit(get_tag_visitor, _value);
+		return std::visit(get_tag_visitor, payload());
+	}
+
+	// splitmix64's finalizer; the hash must not depend on std::hash, which
+	// differs between standard libraries.
+	static uint64_t hash_mix(uint64_t x)
+	{
+		x ^= x >> 30;
+		x *= 0xbf58476d1ce4e5b9ULL;
+		x ^= x >> 27;
+		x *= 0x94d049bb133111ebULL;
+		return x ^ (x >> 31);
+	}
+
+	static uint64_t hash_combine(uint64_t seed, uint64_t v)
+	{
+		return hash_mix(seed + 0x9e3779b97f4a7c15ULL + v);
+	}
+
+	static uint64_t hash_bytes(std::string_view s)
+	{
+		uint64_t h = 0xcbf29ce484222325ULL;	// FNV-1a
+		for (auto c : s)
+			h = (h ^ static_cast<uint8_t>(c)) * 0x100000001b3ULL;
+		return hash_mix(h ^ s.size());
+	}
+
+	// What hash() returns; 0 is kept for "not computed".
+	static uint32_t hash_fold(uint64_t h)
+	{
+		auto v = static_cast<uint32_t>(h ^ (h >> 32));
+		return v ? v : 1;
+	}
+
+	template<typename T>
+	static uint32_t hash_scalar(T v)
+	{
+		uint64_t bits;
+		if constexpr (std::is_floating_point_v<T>) {
+			// -0.0 == 0.0
+			if (v == 0)
+				v = 0;
+			if constexpr (sizeof(T) == 4)
+				bits = std::bit_cast<uint32_t>(v);
+			else
+				bits = std::bit_cast<uint64_t>(v);
+		}
+		else
+			bits = static_cast<uint64_t>(static_cast<int64_t>(v));
+		// seeded by width and kind, so that 1b and 1s differ as they do under ==
+		return hash_fold(hash_combine(sizeof(T) * 2 + std::is_floating_point_v<T>, bits));
+	}
+
+	uint64_t NBT_Value::content_hash(bool frozen) const
+	{
+		auto child = [frozen](const NBT_Value& e) { return frozen ? e.frozen_hash() : e.hash(); };
+		auto sequence = [&](uint64_t h, const auto& elements) {
+			h = hash_combine(h, elements.size());
+			for (const auto& e : elements) {
+				using T = std::decay_t<decltype(e)>;
+				if constexpr (std::is_same_v<T, NBT_Value>)
+					h = hash_combine(h, child(e));
+				else
+					h = hash_combine(h, hash_scalar(e));
+			}
+			return h;
+		};
+		uint64_t h = static_cast<uint64_t>(get_tag());
+		return std::visit([&](const auto& v) -> uint64_t {
+			using T = std::decay_t<decltype(v)>;
+			if constexpr (std::is_same_v<T, End> || std::is_same_v<T, Lazy> || std::is_same_v<T, Shared>)
+				return hash_mix(h);
+			else if constexpr (std::is_arithmetic_v<T>)
+				return hash_scalar(v);
+			else if constexpr (std::is_same_v<T, String>)
+				return hash_combine(h, hash_bytes(v));
+			else if constexpr (std::is_same_v<T, Byte_Array>)
+				return hash_combine(h, hash_bytes(std::string_view(reinterpret_cast<const char*>(v.data()), v.size())));
+			else if constexpr (std::is_same_v<T, List>)
+				// element tag left out: == does not look at it either
+				return v.visit([&](const auto& elements) { return sequence(h, elements); });
+			else if constexpr (std::is_same_v<T, Compound>) {
+				// summed so that entry order does not matter
+				uint64_t sum = 0;
+				for (const auto& [key, value] : v)
+					sum += hash_combine(hash_bytes(key), child(value));
+				return hash_combine(hash_combine(h, v.size()), sum);
+			}
+			else
+				return sequence(h, v);
+			}, payload());
 	}
 
-	NBT_Value& NBT_Value::add_tag(std::string s, NBT_Value v)
+	uint32_t NBT_Value::hash() const
 	{
+		// A node reached through a Shared is in a tree nobody changes again.
+		auto& v = resolved();
+		return &v == this ? hash_fold(content_hash(false)) : v.frozen_hash();
+	}
+
+	uint32_t NBT_Value::frozen_hash() const
+	{
+		auto& v = resolved();
+		// Copies on other threads may hash the same payload at once.
+		std::atomic_ref<uint32_t> cached(v._hash);
+		auto h = cached.load(std::memory_order_relaxed);
+		if (h == 0) {
+			h = hash_fold(v.content_hash(true));
+			cached.store(h, std::memory_order_relaxed);
+		}
+		return h;
+	}
+
+	NBT_Value& NBT_Value::share()
+	{
+		if (!(_state & use_cow) || !is_shareable(_value.index()))
+			return *this;
+		auto node = std::make_shared<NBT_Value>();
+		node->_value = std::move(_value);
+		_value = Shared(std::move(node));
+		return *this;
+	}
+
+	void NBT_Value::rebind_lazy()
+	{
+		auto& lazy = *std::get<Lazy>(_value);
+		if (lazy.context.resource == std::pmr::get_default_resource() && !lazy.context.pool)
+			return;
+		// context.owner still keeps the bytes alive.
+		binary_context context{ std::pmr::get_default_resource(), lazy.context.owner, nullptr };
+		_value = std::make_shared<const lazy_subtree>(lazy_subtree{ std::move(context), lazy.bytes, lazy.type });
+	}
+
+	void NBT_Value::unshare()
+	{
+		materialize();
+		while (_value.index() == shared_index) {
+			auto shared = std::get<Shared>(std::move(_value));
+			if (shared.use_count() == 1) {
+				// Nobody else can see it; the node was created non-const.
+				_value = std::move(const_cast<NBT_Value&>(*shared)._value);
+				materialize();
+				continue;
+			}
+			shared->materialize();
+			// Children that are containers point into shared's tree in turn.
+			auto child = [&](const NBT_Value& v) {
+				NBT_Value c;
+				c._value = is_shareable(v._value.index()) ? payload_type(Shared(shared, &v)) : v._value;
+				c._state = v._state;
+				c._should_be_tag = v._should_be_tag;
+				return c;
+			};
+			std::visit([&](const auto& x) {
+				using T = std::decay_t<decltype(x)>;
+				if constexpr (std::is_same_v<T, Compound>) {
+					Compound cmp;
+					cmp.reserve(x.size());
+					for (const auto& [key, value] : x)
+						cmp.insert_or_assign(key, child(value));
+					_value = std::move(cmp);
+				}
+				else if constexpr (std::is_same_v<T, List>) {
+					if (x.is_packed()) {
+						_value = x;
+						return;
+					}
+					List list(x.element_tag());
+					x.visit([&](const auto& elements) {
+						using E = typename std::decay_t<decltype(elements)>::value_type;
+						if constexpr (std::is_same_v<E, NBT_Value>) {
+							auto& nodes = std::get<0>(list._elements);
+							nodes.reserve(elements.size());
+							for (const auto& e : elements)
+								nodes.push_back(child(e));
+						}
+						});
+					_value = std::move(list);
+				}
+				else
+					_value = x;
+				}, shared->_value);
+		}
+	}
+
+	NBT_Value& NBT_Value::add_tag(std::string_view s, NBT_Value v)
+	{
+		unshare();
+		reset_hash();
 		auto& cmp = std::get<Compound>(_value);
-		cmp[s] = v;
+		cmp[s] = std::move(v);
 		return *this;
 	}
 
-	NBT_Value& NBT_Value::operator[](std::string s)
+	NBT_Compound& NBT_Value::building_compound()
+	{
+		if (get_tag() == tag::TAG_End) {
+			check_should_be(tag::TAG_Compound);
+			_value = Compound();
+		}
+		else if (get_tag() != tag::TAG_Compound)
+			throw NBT_Exception("Bad Visit: *this is not a Compound");
+		unshare();
+		reset_hash();
+		return std::get<Compound>(_value);
+	}
+
+	NBT_List& NBT_Value::building_list()
+	{
+		if (get_tag() == tag::TAG_End) {
+			check_should_be(tag::TAG_List);
+			_value = List();
+		}
+		else if (get_tag() != tag::TAG_List)
+			throw NBT_Exception("Bad Visit: *this is not a List");
+		unshare();
+		reset_hash();
+		return std::get<List>(_value);
+	}
+
+	NBT_Value& NBT_Value::emplace_compound(std::string_view key, size_t capacity)
+	{
+		return emplace(key, Compound()).reserve(capacity);
+	}
+
+	NBT_Value& NBT_Value::emplace_back_compound(size_t capacity)
+	{
+		auto& list = building_list();
+		list.push_back(NBT_Value(Compound()));
+		return list.nodes().back().reserve(capacity);
+	}
+
+	NBT_Value& NBT_Value::reserve(size_t n)
+	{
+		if (get_tag() == tag::TAG_Compound)
+			building_compound().reserve(n);
+		else if (get_tag() == tag::TAG_List)
+			building_list().reserve(n);
+		else
+			throw NBT_Exception("Bad Visit: reserve on " + tag_string(get_tag()));
+		return *this;
+	}
+
+	NBT_Value& NBT_Value::operator[](std::string_view s)
 	{
 		if (get_tag() != tag::TAG_Compound)
 			throw NBT_Exception("Bad Visit: *this is not a Compound");
+		unshare();
+		reset_hash();
 		return std::get<Compound>(_value)[s];
 	}
 
@@ -194,6 +871,8 @@ namespace NBT {
 	{
 		if (get_tag() != tag::TAG_List)
 			throw NBT_Exception("Bad Visit: *this is not a List");
+		unshare();
+		reset_hash();
 		return std::get<List>(_value)[i];
 	}
 
@@ -201,6 +880,8 @@ namespace NBT {
 	{
 		if (get_tag() != tag::TAG_Byte_Array)
 			throw NBT_Exception("Bad Visit: *this is not a Byte_Array");
+		unshare();
+		reset_hash();
 		return std::get<Byte_Array>(_value)[i.index];
 	}
 
@@ -208,6 +889,8 @@ namespace NBT {
 	{
 		if (get_tag() != tag::TAG_Int_Array)
 			throw NBT_Exception("Bad Visit: *this is not a Int_Array");
+		unshare();
+		reset_hash();
 		return std::get<Int_Array>(_value)[i.index];
 	}
 
@@ -215,50 +898,148 @@ namespace NBT {
 	{
 		if (get_tag() != tag::TAG_Long_Array)
 			throw NBT_Exception("Bad Visit: *this is not a Long_Array");
+		unshare();
+		reset_hash();
 		return std::get<Long_Array>(_value)[i.index];
 	}
 
-	std::ifstream& operator>>(std::ifstream& in, NBT_Value& v)
+	// Drains a source into one shared buffer that lazily loaded trees keep alive.
+	static std::shared_ptr<const std::vector<std::byte>> read_all(NBT_Source& source)
 	{
-		auto s = std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
-		NBT_Value temp_v;
+		auto buffer = std::make_shared<std::vector<std::byte>>();
+		size_t size = 0;
+		for (;;) {
+			if (size == buffer->size())
+				buffer->resize(size + std::max<size_t>(size, NBT_Reader::default_window_size));
+			auto got = source.pull(buffer->data() + size, buffer->size() - size);
+			if (got == 0)
+				break;
+			size += got;
+		}
+		buffer->resize(size);
+		buffer->shrink_to_fit();
+		return buffer;
+	}
 
-		if(v.if_use_gz())
-			s = decompressString(s);
+	NBT_Value NBT_Value::get_lazy_root(NBT_Source& source, binary_context ctx)
+	{
+		auto buffer = read_all(source);
+		NBT_Reader reader(buffer->data(), buffer->size());
+		ctx.owner = buffer;
+		return NBT_Value::get_binary_root(reader, ctx);
+	}
 
-		std::istringstream is(s, std::ios::binary);
-		is >> std::noskipws;
-		auto current_tag = NBT_Value::get_binary_tag(is);
-		std::string current_name{""};
-		switch (current_tag)
-		{
-		case NBT_Value::tag::TAG_Compound: {
-			auto temp_cmp = Compound();
-			auto temp_name = NBT_Value::get_binary_string(is);
-			temp_cmp[temp_name] = NBT_Value::get_binary_compound(is);
-			temp_v = std::move(temp_cmp);
-			break;
+	std::ifstream& operator>>(std::ifstream& in, NBT_Value& v)
+	{
+		v.read(in);
+		return in;
+	}
+
+	NBT_Value& NBT_Value::read(std::istream& in, std::pmr::memory_resource* resource, std::shared_ptr<NBT_StringPool> pool)
+	{
+		binary_context ctx{ resource ? resource : std::pmr::get_default_resource(), nullptr, std::move(pool) };
+		// Drop the old tree first so the new one keeps its allocator on assignment.
+		_value = End{};
+		if (if_use_gz() || if_use_zip()) {
+			NBT_InflateSource source(in);
+			if (if_use_lazy()) {
+				*this = get_lazy_root(source, ctx);
+				return *this;
+			}
+			NBT_Reader reader(source);
+			*this = get_binary_root(reader, ctx);
 		}
-		default:
-			break;
+		else {
+			NBT_IstreamSource source(in);
+			if (if_use_lazy()) {
+				*this = get_lazy_root(source, ctx);
+				return *this;
+			}
+			NBT_Reader reader(source);
+			*this = get_binary_root(reader, ctx);
 		}
+		return *this;
+	}
 
-		v = std::move(temp_v);
+	NBT_Value& NBT_Value::load(const std::filesystem::path& path, std::pmr::memory_resource* resource, std::shared_ptr<NBT_StringPool> pool)
+	{
+		binary_context ctx{ resource ? resource : std::pmr::get_default_resource(), nullptr, std::move(pool) };
+		auto file = std::make_shared<const NBT_MappedFile>(path);
+		_value = End{};
+		if (if_use_gz() || if_use_zip()) {
+			NBT_InflateSource source(file->data());
+			if (if_use_lazy()) {
+				*this = get_lazy_root(source, ctx);
+				return *this;
+			}
+			NBT_Reader reader(source);
+			*this = get_binary_root(reader, ctx);
+		}
+		else {
+			NBT_Reader reader(file->data());
+			if (if_use_lazy())
+				ctx.owner = file;
+			*this = get_binary_root(reader, ctx);
+		}
+		return *this;
+	}
 
-		return in;
+	size_t NBT_Value::write_binary(std::span<std::byte> out) const
+	{
+		NBT_Writer writer(out);
+		put_binary_data(writer, *this);
+		return writer.written();
 	}
 
-	std::ofstream& operator<<(std::ofstream& out, NBT_Value& v) {
-		std::ostringstream os(std::ios::binary);
-		NBT_Value::put_binary_data(os, v);
+	std::vector<std::byte> NBT_Value::to_binary() const
+	{
+		std::vector<std::byte> buffer(serialized_size());
+		write_binary(buffer);
+		return buffer;
+	}
 
-		auto s = os.str();
+	void NBT_Value::write(NBT_Writer& writer) const
+	{
+		put_binary_data(writer, *this);
+	}
 
-		if (v.if_use_gz())
-			s = compressString(s);
+	void NBT_Value::write(std::ostream& out, const NBT_DeflateOptions& options) const
+	{
+		auto deflate_to = [this](auto& sink) {
+			NBT_Writer writer(sink);
+			put_binary_data(writer, *this);
+			writer.flush();
+			sink.finish();
+		};
+		if (if_use_gz() || if_use_zip()) {
+			auto framing = if_use_zip() ? NBT_Framing::zlib : NBT_Framing::gzip;
+			if (options.threads == 1) {
+				NBT_DeflateSink sink(out, framing, options);
+				deflate_to(sink);
+			}
+			else {
+				NBT_ParallelDeflateSink sink(out, framing, options);
+				deflate_to(sink);
+			}
+		}
+		else {
+			NBT_OstreamSink sink(out);
+			NBT_Writer writer(sink);
+			put_binary_data(writer, *this);
+			writer.flush();
+		}
+	}
 
-		out << s;
+	void NBT_Value::save(const std::filesystem::path& path, const NBT_DeflateOptions& options) const
+	{
+		std::ofstream out(path, std::ios::binary | std::ios::trunc);
+		if (!out)
+			throw NBT_Exception("Bad Open: cannot open " + path.string());
+		write(out, options);
+	}
 
+	std::ofstream& operator<<(std::ofstream& out, NBT_Value& v) {
+		v.write(out);
 		return out;
 	}
 
@@ -306,7 +1087,7 @@ namespace NBT {
 		return uncompressed_data;
 	}
 
-	std::string compressString(const std::string& uncompressed_data) {
+	std::string compressString(std::string_view uncompressed_data) {
 		z_stream strm;
 		std::string compressed_data;
 
@@ -325,26 +1106,20 @@ namespace NBT {
 		strm.avail_in = uncompressed_data.size();
 		strm.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(uncompressed_data.data()));
 
-		// ѹѭ
-		do {
-			char outbuffer[1024];
-			strm.avail_out = sizeof(outbuffer);
-			strm.next_out = reinterpret_cast<Bytef*>(outbuffer);
-
-			// ѹ
-			ret = deflate(&strm, Z_FINISH);
-			if (ret < 0) {
-				deflateEnd(&strm);
-				return "";
-			}
+		// ѹһηռ
+		compressed_data.resize(deflateBound(&strm, strm.avail_in));
+		strm.avail_out = static_cast<uInt>(compressed_data.size());
+		strm.next_out = reinterpret_cast<Bytef*>(compressed_data.data());
 
-			// ѹݿcompressed_data
-			compressed_data.append(outbuffer, sizeof(outbuffer) - strm.avail_out);
-		} while (strm.avail_out == 0);
+		// ѹ
+		ret = deflate(&strm, Z_FINISH);
 
 		// ѹ
 		deflateEnd(&strm);
+		if (ret != Z_STREAM_END)
+			return "";
 
+		compressed_data.resize(strm.total_out);
 		return compressed_data;
 	}
 
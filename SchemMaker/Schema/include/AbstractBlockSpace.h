@@ -1,27 +1,209 @@
 #pragma once
 
+#include <array>
+#include <concepts>
+#include <cstddef>
+#include <span>
+#include <stdint.h>
 #include <vector>
 
 namespace Schema {
-	template<typename T>
+
+	// Layouts map a block to its position in storage; they are built from the
+	// size of the box and say how many entries it takes.
+
+	// x fastest, then z, then y, as Sponge schematics store BlockData. Rows
+	// along x and slices across y are contiguous.
+	class yzx_layout {
+	private:
+		size_t _width = 0;
+		size_t _slice = 0;
+		size_t _size = 0;
+
+	public:
+		static constexpr bool linear = true;
+
+		yzx_layout() = default;
+
+		yzx_layout(unsigned short width, unsigned short height, unsigned short length) :
+			_width(width), _slice(size_t(width) * length), _size(_slice * height) {}
+
+		size_t size() const { return _size; }
+
+		size_t operator()(unsigned short x, unsigned short y, unsigned short z) const { return x + z * _width + y * _slice; }
+	};
+
+	// 8x8x8 tiles, x fastest, then z, then y, each in Z order, so the blocks
+	// around one are mostly in the same few cache lines whatever the axis.
+	// Each axis is padded to a whole tile. A block's index is the sum of one
+	// precomputed offset per axis.
+	class morton_layout {
+	private:
+		std::vector<size_t> _x;
+		std::vector<size_t> _y;
+		std::vector<size_t> _z;
+		size_t _size = 0;
+
+		static constexpr unsigned tile_bits = 3;
+
+		// Offsets along one axis, whose coordinate bits go every third bit
+		// from shift, and whose tiles are stride apart.
+		static std::vector<size_t> offsets(unsigned short n, unsigned shift, size_t stride) {
+			// The three bits of v at bits 0, 3 and 6.
+			constexpr std::array<uint16_t, 8> spread = { 0, 1, 8, 9, 64, 65, 72, 73 };
+			std::vector<size_t> o(n);
+			for (unsigned i = 0; i < n; i++)
+				o[i] = (i >> tile_bits) * stride + (size_t(spread[i & (tile_side - 1)]) << shift);
+			return o;
+		}
+
+		static size_t tiles(unsigned short n) { return (size_t(n) + tile_side - 1) >> tile_bits; }
+
+	public:
+		static constexpr bool linear = false;
+		static constexpr unsigned tile_side = 1u << tile_bits;
+		static constexpr unsigned tile_volume = tile_side * tile_side * tile_side;
+
+		morton_layout() = default;
+
+		morton_layout(unsigned short width, unsigned short height, unsigned short length) :
+			_x(offsets(width, 0, tile_volume)),
+			_y(offsets(height, 2, tiles(width) * tiles(length) * tile_volume)),
+			_z(offsets(length, 1, tiles(width) * tile_volume)),
+			_size(tiles(width) * tiles(height) * tiles(length) * tile_volume) {}
+
+		size_t size() const { return _size; }
+
+		size_t operator()(unsigned short x, unsigned short y, unsigned short z) const { return _x[x] + _y[y] + _z[z]; }
+	};
+
+	// A width x height x length box of blocks. Storage is any container of
+	// T indexed by position: a vector by default, or a PackedBlockStorage,
+	// whose at() then returns a proxy. Layout orders the blocks in it.
+	template<typename T, typename Storage = std::vector<T>, typename Layout = yzx_layout>
 	class AbstractBlockSpace{
 
 	private:
-		std::vector<T> _block_space;
+		Storage _block_space;
+		Layout _layout;
 		unsigned short _width;
 		unsigned short _height;
 		unsigned short _lenth;
 
+		static constexpr bool contiguous = Layout::linear && std::same_as<Storage, std::vector<T>>;
+
 	public:
-		AbstractBlockSpace(const std::vector<T>& block_space, unsigned short width, unsigned short height, unsigned short lenth) :
-			_block_space(block_space), _width(width), _height(height), _lenth(lenth) {}
+		using layout_type = Layout;
 
-		AbstractBlockSpace(std::vector<T>&& block_space, unsigned short width, unsigned short height, unsigned short lenth) :
-			_block_space(std::move(block_space)), _width(width), _height(height), _lenth(lenth) {}
+		AbstractBlockSpace() :_width(0), _height(0), _lenth(0) {}
 
-		bool is_legal() { return _width * _height * _lenth == _block_space.size(); }
-	};
-}
+		AbstractBlockSpace(unsigned short width, unsigned short height, unsigned short lenth, const T& fill = T())
+			requires std::same_as<Storage, std::vector<T>> :
+			_layout(width, height, lenth), _width(width), _height(height), _lenth(lenth) { _block_space.assign(_layout.size(), fill); }
+
+		// block_space already in Layout's order.
+		AbstractBlockSpace(const Storage& block_space, unsigned short width, unsigned short height, unsigned short lenth) :
+			_block_space(block_space), _layout(width, height, lenth), _width(width), _height(height), _lenth(lenth) {}
+
+		AbstractBlockSpace(Storage&& block_space, unsigned short width, unsigned short height, unsigned short lenth) :
+			_block_space(std::move(block_space)), _layout(width, height, lenth), _width(width), _height(height), _lenth(lenth) {}
+
+		// The same blocks in another layout.
+		template<typename OtherStorage, typename OtherLayout>
+		explicit AbstractBlockSpace(const AbstractBlockSpace<T, OtherStorage, OtherLayout>& other)
+			requires std::same_as<Storage, std::vector<T>> && (!std::same_as<OtherLayout, Layout>) :
+			AbstractBlockSpace(other.width(), other.height(), other.length())
+		{
+			other.for_each([&](unsigned short x, unsigned short y, unsigned short z, const T& v) { at(x, y, z) = v; });
+		}
+
+		unsigned short width() const { return _width; }
+
+		unsigned short height() const { return _height; }
+
+		unsigned short length() const { return _lenth; }
+
+		size_t volume() const { return size_t(_width) * _height * _lenth; }
+
+		const Layout& layout() const { return _layout; }
+
+		size_t index(unsigned short x, unsigned short y, unsigned short z) const { return _layout(x, y, z); }
+
+		decltype(auto) at(unsigned short x, unsigned short y, unsigned short z) { return _block_space[_layout(x, y, z)]; }
+
+		decltype(auto) at(unsigned short x, unsigned short y, unsigned short z) const { return _block_space[_layout(x, y, z)]; }
+
+		decltype(auto) operator()(unsigned short x, unsigned short y, unsigned short z) { return _block_space[_layout(x, y, z)]; }
 
+		decltype(auto) operator()(unsigned short x, unsigned short y, unsigned short z) const { return _block_space[_layout(x, y, z)]; }
 
+		// The width blocks along x at (y, z).
+		std::span<T> row(unsigned short y, unsigned short z) requires contiguous {
+			return { _block_space.data() + _layout(0, y, z), _width };
+		}
 
+		std::span<const T> row(unsigned short y, unsigned short z) const requires contiguous {
+			return { _block_space.data() + _layout(0, y, z), _width };
+		}
+
+		// The width x length blocks at height y, in rows by z.
+		std::span<T> slice(unsigned short y) requires contiguous {
+			return { _block_space.data() + _layout(0, y, 0), size_t(_width) * _lenth };
+		}
+
+		std::span<const T> slice(unsigned short y) const requires contiguous {
+			return { _block_space.data() + _layout(0, y, 0), size_t(_width) * _lenth };
+		}
+
+		// Calls f(x, y, z, block) for every block in storage order, the
+		// cache-friendly order whatever the layout.
+		template<typename F>
+		void for_each(F&& f) {
+			for_each_position([&](unsigned short x, unsigned short y, unsigned short z, size_t i) { f(x, y, z, _block_space[i]); });
+		}
+
+		template<typename F>
+		void for_each(F&& f) const {
+			for_each_position([&](unsigned short x, unsigned short y, unsigned short z, size_t i) { f(x, y, z, _block_space[i]); });
+		}
+
+		// f(x, y, z, i) with i the block's index in storage, in storage order.
+		template<typename F>
+		void for_each_position(F&& f) const {
+			if constexpr (Layout::linear) {
+				size_t i = 0;
+				for (unsigned short y = 0; y < _height; y++)
+					for (unsigned short z = 0; z < _lenth; z++)
+						for (unsigned short x = 0; x < _width; x++)
+							f(x, y, z, i++);
+			}
+			else {
+				constexpr unsigned side = Layout::tile_side;
+				for (unsigned y0 = 0; y0 < _height; y0 += side)
+					for (unsigned z0 = 0; z0 < _lenth; z0 += side)
+						for (unsigned x0 = 0; x0 < _width; x0 += side) {
+							size_t base = _layout(x0, y0, z0);
+							// Edge tiles skip their padding.
+							bool whole = x0 + side <= _width && y0 + side <= _height && z0 + side <= _lenth;
+							for (unsigned i = 0; i < Layout::tile_volume; i++) {
+								unsigned x = x0 + ((i & 1) | (i >> 2 & 2) | (i >> 4 & 4));
+								unsigned z = z0 + ((i >> 1 & 1) | (i >> 3 & 2) | (i >> 5 & 4));
+								unsigned y = y0 + ((i >> 2 & 1) | (i >> 4 & 2) | (i >> 6 & 4));
+								if (whole || (x < _width && y < _height && z < _lenth))
+									f(static_cast<unsigned short>(x), static_cast<unsigned short>(y), static_cast<unsigned short>(z), base + i);
+							}
+						}
+			}
+		}
+
+		T* data() requires std::same_as<Storage, std::vector<T>> { return _block_space.data(); }
+
+		const T* data() const requires std::same_as<Storage, std::vector<T>> { return _block_space.data(); }
+
+		Storage& blocks() { return _block_space; }
+
+		const Storage& blocks() const { return _block_space; }
+
+		bool is_legal() const { return _layout.size() == _block_space.size(); }
+	};
+}
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <concepts>
+#include <cstddef>
+#include <future>
+#include <span>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "AbstractBlockSpace.h"
+#include "NBT_Exception.h"
+
+namespace Schema {
+
+	// Blocks x0 <= x < x1, y0 <= y < y1, z0 <= z < z1.
+	struct BlockBox {
+		unsigned short x0 = 0, y0 = 0, z0 = 0;
+		unsigned short x1 = 0, y1 = 0, z1 = 0;
+
+		size_t volume() const { return size_t(x1 - x0) * (y1 - y0) * (z1 - z0); }
+
+		template<typename Space>
+		static BlockBox of(const Space& space) { return { 0, 0, 0, space.width(), space.height(), space.length() }; }
+	};
+
+	// Region operations split the box into slabs of whole rows, about
+	// slab_blocks blocks each, that threads take in turn; threads 0 means one
+	// per hardware thread. Spaces not stored in a vector, whose blocks share
+	// words, are worked on by the calling thread alone.
+	struct RegionOptions {
+		unsigned threads = 0;
+		size_t slab_blocks = 256 * 1024;
+	};
+
+	// Replaces every from in blocks with to, 16 at a time with AVX2 and 8 with
+	// SSE2. Returns the number replaced.
+	size_t replace_blocks(std::span<uint16_t> blocks, uint16_t from, uint16_t to) noexcept;
+
+	// Number of value in blocks.
+	size_t count_blocks(std::span<const uint16_t> blocks, uint16_t value) noexcept;
+
+	namespace region_detail {
+
+		template<typename Space>
+		void check_box(const Space& space, const BlockBox& box) {
+			if (box.x0 > box.x1 || box.y0 > box.y1 || box.z0 > box.z1 ||
+				box.x1 > space.width() || box.y1 > space.height() || box.z1 > space.length())
+				throw NBT::NBT_Exception("Bad Region: box " + std::to_string(box.x0) + "," + std::to_string(box.y0) + "," +
+					std::to_string(box.z0) + " to " + std::to_string(box.x1) + "," + std::to_string(box.y1) + "," +
+					std::to_string(box.z1) + " outside " + std::to_string(space.width()) + "x" +
+					std::to_string(space.height()) + "x" + std::to_string(space.length()));
+		}
+
+		template<typename Space>
+		struct traits;
+
+		template<typename T, typename Storage, typename Layout>
+		struct traits<AbstractBlockSpace<T, Storage, Layout>> {
+			using value_type = T;
+			static constexpr bool vector = std::same_as<Storage, std::vector<T>> && !std::same_as<T, bool>;
+			static constexpr bool contiguous = vector && Layout::linear;
+		};
+
+		// Sum of row(y, z) over every row of box, rows shared out by slab.
+		template<typename Space, typename Row>
+		size_t for_rows(const Space& space, const BlockBox& box, const RegionOptions& options, Row&& row) {
+			check_box(space, box);
+			if (box.volume() == 0)
+				return 0;
+			size_t depth = box.z1 - box.z0;
+			size_t rows = (box.y1 - box.y0) * depth;
+			size_t slab_rows = std::max<size_t>(1, options.slab_blocks / (box.x1 - box.x0));
+			size_t slabs = (rows + slab_rows - 1) / slab_rows;
+			unsigned threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+			if (!traits<Space>::vector)
+				threads = 1;
+			threads = static_cast<unsigned>(std::min<size_t>(threads, slabs));
+
+			std::atomic<size_t> next = 0;
+			auto work = [&] {
+				size_t total = 0;
+				for (size_t slab; (slab = next.fetch_add(1, std::memory_order_relaxed)) < slabs;) {
+					size_t last = std::min(rows, (slab + 1) * slab_rows);
+					for (size_t r = slab * slab_rows; r < last; r++)
+						total += row(static_cast<unsigned short>(box.y0 + r / depth), static_cast<unsigned short>(box.z0 + r % depth));
+				}
+				return total;
+			};
+			std::vector<std::future<size_t>> helpers;
+			for (unsigned i = 1; i < threads; i++)
+				helpers.push_back(std::async(std::launch::async, work));
+			size_t total = work();
+			for (auto& helper : helpers)
+				total += helper.get();
+			return total;
+		}
+
+		// Calls block(v) on each block of one row, v a T& or, for packed
+		// storage, a proxy; returns the sum of what it returns.
+		template<typename Space, typename Block>
+		size_t each_in_row(Space& space, const BlockBox& box, unsigned short y, unsigned short z, Block&& block) {
+			size_t total = 0;
+			if constexpr (traits<std::remove_const_t<Space>>::contiguous) {
+				for (auto& v : space.row(y, z).subspan(box.x0, box.x1 - box.x0))
+					total += block(v);
+			}
+			else {
+				for (unsigned short x = box.x0; x < box.x1; x++) {
+					decltype(auto) v = space.at(x, y, z);
+					total += block(v);
+				}
+			}
+			return total;
+		}
+
+	}
+
+	// The T of an AbstractBlockSpace, so values passed are not deduced apart.
+	template<typename Space>
+	using block_type = typename region_detail::traits<Space>::value_type;
+
+	// Sets every block in box to value.
+	template<typename Space>
+	void fill(Space& space, const BlockBox& box, const block_type<Space>& value, const RegionOptions& options = {}) {
+		region_detail::for_rows(space, box, options, [&](unsigned short y, unsigned short z) -> size_t {
+			if constexpr (region_detail::traits<Space>::contiguous) {
+				auto row = space.row(y, z).subspan(box.x0, box.x1 - box.x0);
+				std::fill(row.begin(), row.end(), value);
+			}
+			else {
+				for (unsigned short x = box.x0; x < box.x1; x++)
+					space.at(x, y, z) = value;
+			}
+			return 0;
+		});
+	}
+
+	// Sets every block in box that pred accepts to value, as a WorldEdit mask
+	// does. Returns the number set.
+	template<typename Space, typename Pred>
+	size_t replace_if(Space& space, const BlockBox& box, Pred pred, const block_type<Space>& value, const RegionOptions& options = {}) {
+		using T = block_type<Space>;
+		return region_detail::for_rows(space, box, options, [&](unsigned short y, unsigned short z) {
+			return region_detail::each_in_row(space, box, y, z, [&](auto&& v) -> size_t {
+				if (!pred(static_cast<const T&>(v)))
+					return 0;
+				v = value;
+				return 1;
+			});
+		});
+	}
+
+	// Replaces from with to in box. Returns the number replaced.
+	template<typename Space>
+	size_t replace(Space& space, const BlockBox& box, const block_type<Space>& from, const block_type<Space>& to,
+		const RegionOptions& options = {}) {
+		using T = block_type<Space>;
+		if constexpr (region_detail::traits<Space>::contiguous && std::same_as<T, uint16_t>)
+			return region_detail::for_rows(space, box, options, [&](unsigned short y, unsigned short z) {
+				return replace_blocks(space.row(y, z).subspan(box.x0, box.x1 - box.x0), from, to);
+			});
+		else
+			return Schema::replace_if(space, box, [&](const T& v) { return v == from; }, to, options);
+	}
+
+	// Number of blocks in box that pred accepts.
+	template<typename Space, typename Pred>
+	size_t count_if(const Space& space, const BlockBox& box, Pred pred, const RegionOptions& options = {}) {
+		using T = block_type<Space>;
+		return region_detail::for_rows(space, box, options, [&](unsigned short y, unsigned short z) {
+			return region_detail::each_in_row(space, box, y, z, [&](const auto& v) -> size_t {
+				return pred(static_cast<const T&>(v)) ? 1 : 0;
+			});
+		});
+	}
+
+	// Number of value in box.
+	template<typename Space>
+	size_t count(const Space& space, const BlockBox& box, const block_type<Space>& value, const RegionOptions& options = {}) {
+		using T = block_type<Space>;
+		if constexpr (region_detail::traits<Space>::contiguous && std::same_as<T, uint16_t>)
+			return region_detail::for_rows(space, box, options, [&](unsigned short y, unsigned short z) {
+				return count_blocks(space.row(y, z).subspan(box.x0, box.x1 - box.x0), value);
+			});
+		else
+			return Schema::count_if(space, box, [&](const T& v) { return v == value; }, options);
+	}
+
+}
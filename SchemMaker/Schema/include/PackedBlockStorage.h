@@ -0,0 +1,151 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <stdint.h>
+#include <vector>
+
+#include "NBT_Value.h"
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+namespace Schema {
+
+	// Block indices bit-packed into 64 bit words, bits() bits each, as Anvil
+	// chunk sections and Litematica regions store them in a Long_Array.
+	// Storing an index that does not fit widens every entry first.
+	class PackedBlockStorage {
+	public:
+		using value_type = uint16_t;
+
+		enum class layout : uint8_t {
+			aligned,	// whole entries per word, the rest padding (Anvil since 1.16)
+			spanning	// entries cross word boundaries (Litematica, older Anvil)
+		};
+
+		static constexpr unsigned max_bits = 16;
+
+		// Bits for indices below palette_size.
+		static unsigned bits_for(size_t palette_size, unsigned min_bits = 1);
+
+		// Number of words size entries of the given width take.
+		static size_t words_for(size_t size, unsigned bits, layout l);
+
+		class reference {
+		private:
+			PackedBlockStorage* _storage;
+			size_t _index;
+
+		public:
+			reference(PackedBlockStorage* storage, size_t index) :_storage(storage), _index(index) {}
+
+			operator uint16_t() const { return _storage->get(_index); }
+
+			reference& operator=(uint16_t v) { _storage->set(_index, v); return *this; }
+
+			reference& operator=(const reference& r) { return *this = static_cast<uint16_t>(r); }
+		};
+
+	private:
+		// Spanning storage keeps one word past the data, so an entry is always
+		// read and written as the pair of words it may cross.
+		std::vector<uint64_t> _words;
+		size_t _size = 0;
+		unsigned _bits = 1;
+		layout _layout = layout::aligned;
+		uint64_t _mask = 1;
+		unsigned _per_word = 64;
+		// Divides an index (below 2^32) by _per_word with one multiply.
+		uint64_t _div_magic = 0;
+
+		void set_bits(unsigned bits);
+
+		static uint64_t mul_high(uint64_t a, uint64_t b) {
+#if defined(_MSC_VER) && defined(_M_X64)
+			return __umulh(a, b);
+#elif defined(__SIZEOF_INT128__)
+			return static_cast<uint64_t>((static_cast<unsigned __int128>(a) * b) >> 64);
+#else
+			uint64_t a_lo = a & 0xffffffff, a_hi = a >> 32, b_lo = b & 0xffffffff, b_hi = b >> 32;
+			uint64_t mid = a_hi * b_lo + ((a_lo * b_lo) >> 32);
+			uint64_t mid2 = a_lo * b_hi + (mid & 0xffffffff);
+			return a_hi * b_hi + (mid >> 32) + (mid2 >> 32);
+#endif
+		}
+
+	public:
+		PackedBlockStorage() { set_bits(1); }
+
+		// size zero entries of bits bits; throws "Bad Storage" for more than
+		// 2^32 entries or a width outside 1..16.
+		explicit PackedBlockStorage(size_t size, unsigned bits = 1, layout l = layout::aligned);
+
+		// values packed at the least width that holds them, or min_bits.
+		explicit PackedBlockStorage(std::span<const uint16_t> values, unsigned min_bits = 1, layout l = layout::aligned);
+
+		// Takes a Long_Array as stored; throws "Bad Storage" if its length
+		// does not match.
+		static PackedBlockStorage from_long_array(std::span<const NBT::Long> longs, size_t size, unsigned bits, layout l);
+
+		NBT::Long_Array to_long_array() const;
+
+		size_t size() const { return _size; }
+
+		unsigned bits() const { return _bits; }
+
+		layout get_layout() const { return _layout; }
+
+		// The packed words, without the spanning layout's spare word.
+		std::span<const uint64_t> words() const { return { _words.data(), words_for(_size, _bits, _layout) }; }
+
+		uint16_t get(size_t i) const {
+			if (_layout == layout::aligned) {
+				size_t word = mul_high(_div_magic, i);
+				unsigned shift = static_cast<unsigned>(i - word * _per_word) * _bits;
+				return static_cast<uint16_t>((_words[word] >> shift) & _mask);
+			}
+			uint64_t bit = uint64_t(i) * _bits;
+			size_t word = bit >> 6;
+			unsigned off = bit & 63;
+			// (x << 1) << (63 - off) is x << (64 - off), and 0 when off is 0.
+			return static_cast<uint16_t>(((_words[word] >> off) | ((_words[word + 1] << 1) << (63 - off))) & _mask);
+		}
+
+		void set(size_t i, uint16_t v) {
+			if (v > _mask)
+				grow(bits_for(size_t(v) + 1));
+			if (_layout == layout::aligned) {
+				size_t word = mul_high(_div_magic, i);
+				unsigned shift = static_cast<unsigned>(i - word * _per_word) * _bits;
+				_words[word] = (_words[word] & ~(_mask << shift)) | (uint64_t(v) << shift);
+				return;
+			}
+			uint64_t bit = uint64_t(i) * _bits;
+			size_t word = bit >> 6;
+			unsigned off = bit & 63;
+			_words[word] = (_words[word] & ~(_mask << off)) | (uint64_t(v) << off);
+			_words[word + 1] = (_words[word + 1] & ~((_mask >> 1) >> (63 - off))) | ((uint64_t(v) >> 1) >> (63 - off));
+		}
+
+		uint16_t operator[](size_t i) const { return get(i); }
+
+		reference operator[](size_t i) { return { this, i }; }
+
+		// Repacks every entry at a larger width; smaller widths are ignored.
+		void grow(unsigned bits);
+
+		// Room for indices below palette_size.
+		void reserve_palette(size_t palette_size) { grow(bits_for(palette_size)); }
+
+		// Bulk copies of out.size() / in.size() entries from entry first on.
+		// pack grows the width first if an index needs it.
+		void unpack(std::span<uint16_t> out, size_t first = 0) const;
+
+		void pack(std::span<const uint16_t> in, size_t first = 0);
+
+		std::vector<uint16_t> unpack() const;
+	};
+
+}
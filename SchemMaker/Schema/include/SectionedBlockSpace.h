@@ -0,0 +1,254 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+#include "AbstractBlockSpace.h"
+#include "PackedBlockStorage.h"
+
+namespace Schema {
+
+	// A box of blocks split into 16x16x16 sections, each with its own palette
+	// of the T it holds and its blocks as bit-packed indices into it. Sections
+	// only holding the fill block (air) are not allocated, and sections
+	// holding one block keep no indices. Within a section and across them the
+	// order is x fastest, then z, then y, as in AbstractBlockSpace.
+	template<typename T>
+	class SectionedBlockSpace {
+	public:
+		static constexpr unsigned section_bits = 4;
+		static constexpr unsigned section_side = 1u << section_bits;
+		static constexpr unsigned section_volume = section_side * section_side * section_side;
+
+		class Section {
+		private:
+			std::vector<T> _palette;
+			// Empty while the section holds _palette[0] only.
+			PackedBlockStorage _indices;
+
+		public:
+			explicit Section(const T& fill) :_palette{ fill } {}
+
+			Section(std::vector<T> palette, PackedBlockStorage indices) :
+				_palette(std::move(palette)), _indices(std::move(indices)) {}
+
+			bool is_uniform() const { return _indices.size() == 0; }
+
+			const std::vector<T>& palette() const { return _palette; }
+
+			const PackedBlockStorage& indices() const { return _indices; }
+
+			const T& get(size_t i) const { return _palette[is_uniform() ? 0 : _indices.get(i)]; }
+
+			void set(size_t i, const T& v) {
+				auto it = std::find(_palette.begin(), _palette.end(), v);
+				uint16_t index = static_cast<uint16_t>(it - _palette.begin());
+				if (it == _palette.end()) {
+					if (_palette.size() > UINT16_MAX)
+						throw NBT::NBT_Exception("Bad Storage: section palette full");
+					_palette.push_back(v);
+				}
+				if (is_uniform()) {
+					if (index == 0)
+						return;
+					_indices = PackedBlockStorage(section_volume, PackedBlockStorage::bits_for(_palette.size()));
+				}
+				_indices.set(i, index);
+			}
+
+			// All 4096 blocks, in section order.
+			void unpack(T* out) const {
+				if (is_uniform()) {
+					std::fill_n(out, section_volume, _palette[0]);
+					return;
+				}
+				uint16_t indices[section_volume];
+				_indices.unpack(indices);
+				for (size_t i = 0; i < section_volume; i++)
+					out[i] = _palette[indices[i]];
+			}
+
+			// Drops palette entries no block uses, at the least width for the
+			// rest, down to a uniform section if one is left.
+			void compact() {
+				if (is_uniform())
+					return;
+				uint16_t indices[section_volume];
+				_indices.unpack(indices);
+				std::vector<uint16_t> remap(_palette.size(), UINT16_MAX);
+				std::vector<T> palette;
+				for (auto& index : indices) {
+					if (remap[index] == UINT16_MAX) {
+						remap[index] = static_cast<uint16_t>(palette.size());
+						palette.push_back(std::move(_palette[index]));
+					}
+					index = remap[index];
+				}
+				_palette = std::move(palette);
+				_indices = _palette.size() == 1 ? PackedBlockStorage() : PackedBlockStorage(indices);
+			}
+
+			size_t memory_usage() const {
+				return sizeof(Section) + _palette.capacity() * sizeof(T) + _indices.words().size_bytes();
+			}
+		};
+
+	private:
+		std::vector<std::unique_ptr<Section>> _sections;
+		T _fill;
+		uint32_t _width;
+		uint32_t _height;
+		uint32_t _length;
+
+		static uint32_t sections_along(uint32_t blocks) { return (blocks + section_side - 1) >> section_bits; }
+
+		size_t section_index(uint32_t x, uint32_t y, uint32_t z) const {
+			return (x >> section_bits) + ((z >> section_bits) + size_t(y >> section_bits) * sections_z()) * sections_x();
+		}
+
+		static size_t local_index(uint32_t x, uint32_t y, uint32_t z) {
+			constexpr uint32_t m = section_side - 1;
+			return (x & m) + ((z & m) + (y & m) * section_side) * section_side;
+		}
+
+	public:
+		SectionedBlockSpace() :_fill(), _width(0), _height(0), _length(0) {}
+
+		// An empty box: every block fill, no section allocated.
+		SectionedBlockSpace(uint32_t width, uint32_t height, uint32_t length, const T& fill = T()) :
+			_sections(size_t(sections_along(width)) * sections_along(height) * sections_along(length)),
+			_fill(fill), _width(width), _height(height), _length(length) {}
+
+		// Sections of a dense space; those left all fill are not allocated.
+		template<typename Storage, typename Layout>
+		explicit SectionedBlockSpace(const AbstractBlockSpace<T, Storage, Layout>& dense, const T& fill = T()) :
+			SectionedBlockSpace(dense.width(), dense.height(), dense.length(), fill)
+		{
+			for (uint32_t sy = 0; sy < sections_y(); sy++)
+				for (uint32_t sz = 0; sz < sections_z(); sz++)
+					for (uint32_t sx = 0; sx < sections_x(); sx++) {
+						uint16_t indices[section_volume];
+						std::vector<T> palette{ fill };
+						// Cells past the edge of the box stay fill.
+						std::fill_n(indices, section_volume, uint16_t(0));
+						uint32_t x0 = sx << section_bits, y0 = sy << section_bits, z0 = sz << section_bits;
+						uint32_t x1 = std::min(x0 + section_side, _width);
+						uint32_t y1 = std::min(y0 + section_side, _height);
+						uint32_t z1 = std::min(z0 + section_side, _length);
+						// Neighbouring blocks are mostly the same, so the last
+						// hit is tried before the palette is searched.
+						uint16_t last = 0;
+						for (uint32_t y = y0; y < y1; y++)
+							for (uint32_t z = z0; z < z1; z++)
+								for (uint32_t x = x0; x < x1; x++) {
+									const T& v = dense.at(x, y, z);
+									if (!(palette[last] == v)) {
+										auto it = std::find(palette.begin(), palette.end(), v);
+										if (it == palette.end()) {
+											if (palette.size() > UINT16_MAX)
+												throw NBT::NBT_Exception("Bad Storage: section palette full");
+											it = palette.insert(it, v);
+										}
+										last = static_cast<uint16_t>(it - palette.begin());
+									}
+									indices[local_index(x, y, z)] = last;
+								}
+						auto& section = _sections[section_index(x0, y0, z0)];
+						section = std::make_unique<Section>(std::move(palette), PackedBlockStorage(indices));
+						section->compact();
+						if (section->is_uniform() && section->palette()[0] == _fill)
+							section.reset();
+					}
+		}
+
+		uint32_t width() const { return _width; }
+
+		uint32_t height() const { return _height; }
+
+		uint32_t length() const { return _length; }
+
+		size_t volume() const { return size_t(_width) * _height * _length; }
+
+		uint32_t sections_x() const { return sections_along(_width); }
+
+		uint32_t sections_y() const { return sections_along(_height); }
+
+		uint32_t sections_z() const { return sections_along(_length); }
+
+		const T& fill_value() const { return _fill; }
+
+		const T& at(uint32_t x, uint32_t y, uint32_t z) const {
+			const auto& section = _sections[section_index(x, y, z)];
+			return section ? section->get(local_index(x, y, z)) : _fill;
+		}
+
+		void set(uint32_t x, uint32_t y, uint32_t z, const T& v) {
+			auto& section = _sections[section_index(x, y, z)];
+			if (!section) {
+				if (v == _fill)
+					return;
+				section = std::make_unique<Section>(_fill);
+			}
+			section->set(local_index(x, y, z), v);
+		}
+
+		// The section holding block (x, y, z), or null if it is all fill.
+		const Section* section_at(uint32_t x, uint32_t y, uint32_t z) const { return _sections[section_index(x, y, z)].get(); }
+
+		size_t allocated_sections() const {
+			return std::count_if(_sections.begin(), _sections.end(), [](const auto& s) { return s != nullptr; });
+		}
+
+		// Compacts every section and frees those left all fill, as after
+		// many set calls.
+		void compact() {
+			for (auto& section : _sections) {
+				if (!section)
+					continue;
+				section->compact();
+				if (section->is_uniform() && section->palette()[0] == _fill)
+					section.reset();
+			}
+		}
+
+		// Bytes held, counting one pointer per section.
+		size_t memory_usage() const {
+			size_t bytes = sizeof(*this) + _sections.capacity() * sizeof(std::unique_ptr<Section>);
+			for (const auto& section : _sections)
+				if (section)
+					bytes += section->memory_usage();
+			return bytes;
+		}
+
+		// The blocks as one dense space; throws "Bad Storage" if an axis is
+		// longer than AbstractBlockSpace holds.
+		AbstractBlockSpace<T> to_dense() const {
+			if (_width > UINT16_MAX || _height > UINT16_MAX || _length > UINT16_MAX)
+				throw NBT::NBT_Exception("Bad Storage: too large for a dense space");
+			AbstractBlockSpace<T> dense(static_cast<unsigned short>(_width), static_cast<unsigned short>(_height),
+				static_cast<unsigned short>(_length), _fill);
+			std::vector<T> blocks(section_volume);
+			for (uint32_t sy = 0; sy < sections_y(); sy++)
+				for (uint32_t sz = 0; sz < sections_z(); sz++)
+					for (uint32_t sx = 0; sx < sections_x(); sx++) {
+						uint32_t x0 = sx << section_bits, y0 = sy << section_bits, z0 = sz << section_bits;
+						const auto& section = _sections[section_index(x0, y0, z0)];
+						if (!section)
+							continue;
+						section->unpack(blocks.data());
+						uint32_t x1 = std::min(x0 + section_side, _width);
+						uint32_t y1 = std::min(y0 + section_side, _height);
+						uint32_t z1 = std::min(z0 + section_side, _length);
+						for (uint32_t y = y0; y < y1; y++)
+							for (uint32_t z = z0; z < z1; z++)
+								std::copy_n(blocks.begin() + local_index(x0, y, z), x1 - x0,
+									dense.row(static_cast<unsigned short>(y), static_cast<unsigned short>(z)).begin() + x0);
+					}
+			return dense;
+		}
+	};
+
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <filesystem>
+#include <span>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "AbstractBlockSpace.h"
+#include "NBT_Value.h"
+
+namespace Schema {
+
+	// Decodes exactly out.size() unsigned LEB128 varints from in, as Sponge
+	// BlockData stores palette indices. Runs of one-byte varints (palettes
+	// of up to 128 entries) are widened 16 at a time, and with SSSE3 mixed
+	// one- and two-byte varints 8 bytes at a time through a shuffle table.
+	// Throws "Bad Schematic" if in is short, has bytes left over, or holds a
+	// value above 65535. Returns the largest value decoded.
+	uint16_t decode_varints(std::span<const std::byte> in, std::span<uint16_t> out);
+
+	// The reverse: writes each value of in, or remap[value] if remap is not
+	// empty, as a varint into out, one store per value. Throws "Bad
+	// Schematic" if out is too small or a value is past the end of remap.
+	// Returns the bytes written.
+	size_t encode_varints(std::span<const uint16_t> in, std::span<const uint16_t> remap, std::span<std::byte> out);
+
+	// A Sponge schematic (versions 1 to 3): its blocks as indices into a
+	// palette of block state strings, with the block entities and metadata
+	// kept as NBT.
+	class SpongeSchematic {
+	private:
+		int _version = 2;
+		NBT::Int _data_version = 0;
+		std::array<NBT::Int, 3> _offset{};
+		std::vector<std::string> _palette;
+		AbstractBlockSpace<uint16_t> _blocks;
+		// List of Compounds, each with its Pos relative to the schematic.
+		NBT::NBT_Value _block_entities;
+		NBT::NBT_Value _metadata;
+
+	public:
+		SpongeSchematic() = default;
+
+		SpongeSchematic(AbstractBlockSpace<uint16_t> blocks, std::vector<std::string> palette) :
+			_palette(std::move(palette)), _blocks(std::move(blocks)) {}
+
+		// root as loaded: a v1/v2 "Schematic" root, or the v3 unnamed root
+		// around it. Throws "Bad Schematic" if a required field is missing,
+		// or if BlockData does not match the size or the palette.
+		static SpongeSchematic from_nbt(const NBT::NBT_Value& root);
+
+		// Sponge files are gzipped; state is as for NBT_Value::load.
+		static SpongeSchematic load(const std::filesystem::path& path, int state = NBT::NBT_Value::use_gz);
+
+		int version() const { return _version; }
+
+		NBT::Int data_version() const { return _data_version; }
+
+		const std::array<NBT::Int, 3>& offset() const { return _offset; }
+
+		// Layout to_nbt writes, 2 for a new schematic. Block entities are
+		// written as they are held, not converted between versions.
+		SpongeSchematic& set_version(int version);
+
+		SpongeSchematic& set_data_version(NBT::Int data_version) { _data_version = data_version; return *this; }
+
+		SpongeSchematic& set_offset(const std::array<NBT::Int, 3>& offset) { _offset = offset; return *this; }
+
+		// Block state of each index; indices no entry names are empty.
+		std::vector<std::string>& palette() { return _palette; }
+
+		const std::vector<std::string>& palette() const { return _palette; }
+
+		AbstractBlockSpace<uint16_t>& blocks() { return _blocks; }
+
+		const AbstractBlockSpace<uint16_t>& blocks() const { return _blocks; }
+
+		const std::string& block_at(unsigned short x, unsigned short y, unsigned short z) const {
+			return _palette[_blocks.at(x, y, z)];
+		}
+
+		NBT::NBT_Value& block_entities() { return _block_entities; }
+
+		const NBT::NBT_Value& block_entities() const { return _block_entities; }
+
+		NBT::NBT_Value& metadata() { return _metadata; }
+
+		const NBT::NBT_Value& metadata() const { return _metadata; }
+
+		// The schematic as a tree in its version's layout. Palette entries no
+		// block uses are dropped and the rest renumbered by falling count, so
+		// the commonest blocks get one-byte varints; *this is left as it is.
+		// Throws "Bad Schematic" if a block's index is not in the palette or
+		// two used entries have the same name.
+		NBT::NBT_Value to_nbt() const;
+
+		// Gzipped, as Sponge files are.
+		void save(const std::filesystem::path& path, const NBT::NBT_DeflateOptions& options = {}) const;
+	};
+
+}
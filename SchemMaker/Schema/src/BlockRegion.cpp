@@ -0,0 +1,113 @@
+#include "BlockRegion.h"
+
+#include <bit>
+
+#include "NBT_Endian.h"
+
+#ifdef NBT_SSE2
+#include <immintrin.h>
+#endif
+
+namespace Schema {
+
+	using namespace NBT;
+
+	namespace {
+
+		// Each kernel works through whole vectors and leaves the tail,
+		// returning how far it got; a matching lane sets two mask bits.
+		// Vectors without a match are not stored, so sparse replaces leave
+		// most cache lines clean.
+
+#ifdef NBT_SSE2
+		NBT_TARGET("avx2")
+		size_t replace_avx2(uint16_t* p, size_t n, uint16_t from, uint16_t to, size_t& replaced) noexcept {
+			const __m256i f = _mm256_set1_epi16(static_cast<short>(from));
+			const __m256i t = _mm256_set1_epi16(static_cast<short>(to));
+			size_t i = 0, bits = 0;
+			for (; i + 16 <= n; i += 16) {
+				__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+				__m256i eq = _mm256_cmpeq_epi16(v, f);
+				uint32_t m = static_cast<uint32_t>(_mm256_movemask_epi8(eq));
+				if (!m)
+					continue;
+				bits += std::popcount(m);
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(p + i), _mm256_blendv_epi8(v, t, eq));
+			}
+			replaced += bits / 2;
+			return i;
+		}
+
+		NBT_TARGET("avx2")
+		size_t count_avx2(const uint16_t* p, size_t n, uint16_t value, size_t& counted) noexcept {
+			const __m256i c = _mm256_set1_epi16(static_cast<short>(value));
+			size_t i = 0, bits = 0;
+			for (; i + 16 <= n; i += 16) {
+				__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+				bits += std::popcount(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi16(v, c))));
+			}
+			counted += bits / 2;
+			return i;
+		}
+
+		size_t replace_sse2(uint16_t* p, size_t n, uint16_t from, uint16_t to, size_t& replaced) noexcept {
+			const __m128i f = _mm_set1_epi16(static_cast<short>(from));
+			const __m128i t = _mm_set1_epi16(static_cast<short>(to));
+			size_t i = 0, bits = 0;
+			for (; i + 8 <= n; i += 8) {
+				__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+				__m128i eq = _mm_cmpeq_epi16(v, f);
+				uint32_t m = static_cast<uint32_t>(_mm_movemask_epi8(eq));
+				if (!m)
+					continue;
+				bits += std::popcount(m);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(p + i), _mm_or_si128(_mm_and_si128(eq, t), _mm_andnot_si128(eq, v)));
+			}
+			replaced += bits / 2;
+			return i;
+		}
+
+		size_t count_sse2(const uint16_t* p, size_t n, uint16_t value, size_t& counted) noexcept {
+			const __m128i c = _mm_set1_epi16(static_cast<short>(value));
+			size_t i = 0, bits = 0;
+			for (; i + 8 <= n; i += 8) {
+				__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+				bits += std::popcount(static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi16(v, c))));
+			}
+			counted += bits / 2;
+			return i;
+		}
+#endif
+
+	}
+
+	size_t replace_blocks(std::span<uint16_t> blocks, uint16_t from, uint16_t to) noexcept
+	{
+		uint16_t* p = blocks.data();
+		size_t n = blocks.size(), i = 0, replaced = 0;
+#ifdef NBT_SSE2
+		static const bool avx2 = cpu_simd_level() >= simd_level::avx2;
+		i = avx2 ? replace_avx2(p, n, from, to, replaced) : replace_sse2(p, n, from, to, replaced);
+#endif
+		for (; i < n; i++) {
+			bool hit = p[i] == from;
+			p[i] = hit ? to : p[i];
+			replaced += hit;
+		}
+		return replaced;
+	}
+
+	size_t count_blocks(std::span<const uint16_t> blocks, uint16_t value) noexcept
+	{
+		const uint16_t* p = blocks.data();
+		size_t n = blocks.size(), i = 0, counted = 0;
+#ifdef NBT_SSE2
+		static const bool avx2 = cpu_simd_level() >= simd_level::avx2;
+		i = avx2 ? count_avx2(p, n, value, counted) : count_sse2(p, n, value, counted);
+#endif
+		for (; i < n; i++)
+			counted += p[i] == value;
+		return counted;
+	}
+
+}
@@ -0,0 +1,253 @@
+#include "PackedBlockStorage.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <utility>
+
+namespace Schema {
+
+	using namespace NBT;
+
+	namespace {
+
+		// Entry J of a run of 64 spanning entries, which starts a word.
+		template<unsigned Bits, size_t... J>
+		void unpack_block(const uint64_t* words, uint16_t* out, std::index_sequence<J...>) noexcept {
+			constexpr uint64_t mask = (uint64_t(1) << Bits) - 1;
+			((out[J] = static_cast<uint16_t>(((words[J * Bits / 64] >> (J * Bits % 64)) |
+				(J * Bits % 64 + Bits > 64 ? words[J * Bits / 64 + 1] << (64 - J * Bits % 64) % 64 : 0)) & mask)), ...);
+		}
+
+		template<unsigned Bits, size_t... J>
+		void pack_block(uint64_t* words, const uint16_t* in, std::index_sequence<J...>) noexcept {
+			uint64_t w[Bits] = {};
+			((w[J * Bits / 64] |= uint64_t(in[J]) << (J * Bits % 64)), ...);
+			((J * Bits % 64 + Bits > 64 ? void(w[J * Bits / 64 + 1] |= uint64_t(in[J]) >> (64 - J * Bits % 64) % 64) : void()), ...);
+			std::copy(w, w + Bits, words);
+		}
+
+		// Aligned: the entries of one word.
+		template<unsigned Bits, size_t... J>
+		void unpack_word(uint64_t w, uint16_t* out, std::index_sequence<J...>) noexcept {
+			constexpr uint64_t mask = (uint64_t(1) << Bits) - 1;
+			((out[J] = static_cast<uint16_t>((w >> (J * Bits)) & mask)), ...);
+		}
+
+		template<unsigned Bits, size_t... J>
+		uint64_t pack_word(const uint16_t* in, std::index_sequence<J...>) noexcept {
+			return ((uint64_t(in[J]) << (J * Bits)) | ...);
+		}
+
+		// Bulk kernels for one width and layout. With Bits a constant every
+		// shift, mask and division by the entries per word is fixed, and no
+		// entry takes a branch.
+		template<unsigned Bits, bool Spanning>
+		void unpack_range(const uint64_t* words, size_t first, size_t count, uint16_t* out) noexcept {
+			constexpr uint64_t mask = (uint64_t(1) << Bits) - 1;
+			if constexpr (Spanning) {
+				auto one = [&](size_t i) {
+					uint64_t bit = uint64_t(first + i) * Bits;
+					size_t word = bit >> 6;
+					unsigned off = bit & 63;
+					out[i] = static_cast<uint16_t>(((words[word] >> off) | ((words[word + 1] << 1) << (63 - off))) & mask);
+				};
+				size_t i = 0;
+				for (; i < count && (first + i) % 64; i++)
+					one(i);
+				// 64 entries take exactly Bits words; every offset is a constant.
+				for (; count - i >= 64; i += 64)
+					unpack_block<Bits>(words + (first + i) / 64 * Bits, out + i, std::make_index_sequence<64>());
+				for (; i < count; i++)
+					one(i);
+			}
+			else {
+				constexpr unsigned per_word = 64 / Bits;
+				size_t i = 0, index = first;
+				for (; i < count && index % per_word; i++, index++)
+					out[i] = static_cast<uint16_t>((words[index / per_word] >> (index % per_word * Bits)) & mask);
+				// Whole words: per_word independent shifts of one load.
+				for (; count - i >= per_word; i += per_word, index += per_word)
+					unpack_word<Bits>(words[index / per_word], out + i, std::make_index_sequence<per_word>());
+				for (; i < count; i++, index++)
+					out[i] = static_cast<uint16_t>((words[index / per_word] >> (index % per_word * Bits)) & mask);
+			}
+		}
+
+		// Entries are assumed to fit in Bits.
+		template<unsigned Bits, bool Spanning>
+		void pack_range(uint64_t* words, size_t first, size_t count, const uint16_t* in) noexcept {
+			constexpr uint64_t mask = (uint64_t(1) << Bits) - 1;
+			if constexpr (Spanning) {
+				size_t i = 0;
+				// Up to a multiple of 64 entries, which starts a word.
+				for (; i < count && (first + i) % 64; i++) {
+					uint64_t bit = uint64_t(first + i) * Bits;
+					size_t word = bit >> 6;
+					unsigned off = bit & 63;
+					uint64_t v = in[i];
+					words[word] = (words[word] & ~(mask << off)) | (v << off);
+					words[word + 1] = (words[word + 1] & ~((mask >> 1) >> (63 - off))) | ((v >> 1) >> (63 - off));
+				}
+				for (; count - i >= 64; i += 64)
+					pack_block<Bits>(words + (first + i) / 64 * Bits, in + i, std::make_index_sequence<64>());
+				for (; i < count; i++) {
+					uint64_t bit = uint64_t(first + i) * Bits;
+					size_t word = bit >> 6;
+					unsigned off = bit & 63;
+					uint64_t v = in[i];
+					words[word] = (words[word] & ~(mask << off)) | (v << off);
+					words[word + 1] = (words[word + 1] & ~((mask >> 1) >> (63 - off))) | ((v >> 1) >> (63 - off));
+				}
+			}
+			else {
+				constexpr unsigned per_word = 64 / Bits;
+				size_t i = 0, index = first;
+				auto put = [&](size_t index, uint64_t v) {
+					unsigned shift = index % per_word * Bits;
+					auto& w = words[index / per_word];
+					w = (w & ~(mask << shift)) | (v << shift);
+				};
+				for (; i < count && index % per_word; i++, index++)
+					put(index, in[i]);
+				// Whole words are stored outright, padding cleared.
+				for (; count - i >= per_word; i += per_word, index += per_word)
+					words[index / per_word] = pack_word<Bits>(in + i, std::make_index_sequence<per_word>());
+				for (; i < count; i++, index++)
+					put(index, in[i]);
+			}
+		}
+
+		using unpack_fn = void(*)(const uint64_t*, size_t, size_t, uint16_t*) noexcept;
+		using pack_fn = void(*)(uint64_t*, size_t, size_t, const uint16_t*) noexcept;
+
+		template<bool Spanning, size_t... I>
+		constexpr std::array<unpack_fn, sizeof...(I)> make_unpackers(std::index_sequence<I...>) {
+			return { &unpack_range<I + 1, Spanning>... };
+		}
+
+		template<bool Spanning, size_t... I>
+		constexpr std::array<pack_fn, sizeof...(I)> make_packers(std::index_sequence<I...>) {
+			return { &pack_range<I + 1, Spanning>... };
+		}
+
+		// Indexed by layout, then bits - 1.
+		constexpr std::array<unpack_fn, PackedBlockStorage::max_bits> unpackers[2] = {
+			make_unpackers<false>(std::make_index_sequence<PackedBlockStorage::max_bits>()),
+			make_unpackers<true>(std::make_index_sequence<PackedBlockStorage::max_bits>())
+		};
+
+		constexpr std::array<pack_fn, PackedBlockStorage::max_bits> packers[2] = {
+			make_packers<false>(std::make_index_sequence<PackedBlockStorage::max_bits>()),
+			make_packers<true>(std::make_index_sequence<PackedBlockStorage::max_bits>())
+		};
+
+		void check_bits(unsigned bits) {
+			if (bits < 1 || bits > PackedBlockStorage::max_bits)
+				throw NBT_Exception("Bad Storage: " + std::to_string(bits) + " bits per entry");
+		}
+
+		void check_range(size_t first, size_t count, size_t size) {
+			if (first > size || count > size - first)
+				throw NBT_Exception("Bad Storage: entries " + std::to_string(first) + "+" + std::to_string(count) +
+					" past " + std::to_string(size));
+		}
+
+	}
+
+	unsigned PackedBlockStorage::bits_for(size_t palette_size, unsigned min_bits)
+	{
+		unsigned bits = palette_size > 1 ? static_cast<unsigned>(std::bit_width(palette_size - 1)) : 1;
+		return std::max(bits, min_bits);
+	}
+
+	size_t PackedBlockStorage::words_for(size_t size, unsigned bits, layout l)
+	{
+		if (l == layout::aligned) {
+			size_t per_word = 64 / bits;
+			return (size + per_word - 1) / per_word;
+		}
+		return (size * bits + 63) / 64;
+	}
+
+	void PackedBlockStorage::set_bits(unsigned bits)
+	{
+		_bits = bits;
+		_mask = (uint64_t(1) << bits) - 1;
+		_per_word = 64 / bits;
+		_div_magic = UINT64_MAX / _per_word + 1;
+	}
+
+	PackedBlockStorage::PackedBlockStorage(size_t size, unsigned bits, layout l) :
+		_size(size), _layout(l)
+	{
+		check_bits(bits);
+		if (size > UINT32_MAX)
+			throw NBT_Exception("Bad Storage: " + std::to_string(size) + " entries");
+		set_bits(bits);
+		_words.assign(words_for(size, bits, l) + (l == layout::spanning), 0);
+	}
+
+	PackedBlockStorage::PackedBlockStorage(std::span<const uint16_t> values, unsigned min_bits, layout l) :
+		PackedBlockStorage(values.size(),
+			bits_for(values.empty() ? 0 : size_t(*std::max_element(values.begin(), values.end())) + 1, min_bits), l)
+	{
+		packers[l == layout::spanning][_bits - 1](_words.data(), 0, values.size(), values.data());
+	}
+
+	PackedBlockStorage PackedBlockStorage::from_long_array(std::span<const Long> longs, size_t size, unsigned bits, layout l)
+	{
+		PackedBlockStorage storage(size, bits, l);
+		size_t expected = words_for(size, bits, l);
+		if (longs.size() != expected)
+			throw NBT_Exception("Bad Storage: " + std::to_string(longs.size()) + " longs for " +
+				std::to_string(size) + " entries of " + std::to_string(bits) + " bits, expected " + std::to_string(expected));
+		std::copy(longs.begin(), longs.end(), storage._words.begin());
+		return storage;
+	}
+
+	Long_Array PackedBlockStorage::to_long_array() const
+	{
+		auto w = words();
+		return Long_Array(w.begin(), w.end());
+	}
+
+	void PackedBlockStorage::grow(unsigned bits)
+	{
+		if (bits <= _bits)
+			return;
+		check_bits(bits);
+		// Through a small buffer, so growing never holds the space unpacked.
+		PackedBlockStorage wider(_size, bits, _layout);
+		uint16_t buffer[4096];
+		for (size_t first = 0; first < _size; first += std::size(buffer)) {
+			size_t n = std::min(std::size(buffer), _size - first);
+			unpack({ buffer, n }, first);
+			packers[_layout == layout::spanning][bits - 1](wider._words.data(), first, n, buffer);
+		}
+		*this = std::move(wider);
+	}
+
+	void PackedBlockStorage::unpack(std::span<uint16_t> out, size_t first) const
+	{
+		check_range(first, out.size(), _size);
+		unpackers[_layout == layout::spanning][_bits - 1](_words.data(), first, out.size(), out.data());
+	}
+
+	void PackedBlockStorage::pack(std::span<const uint16_t> in, size_t first)
+	{
+		check_range(first, in.size(), _size);
+		if (in.empty())
+			return;
+		grow(bits_for(size_t(*std::max_element(in.begin(), in.end())) + 1));
+		packers[_layout == layout::spanning][_bits - 1](_words.data(), first, in.size(), in.data());
+	}
+
+	std::vector<uint16_t> PackedBlockStorage::unpack() const
+	{
+		std::vector<uint16_t> values(_size);
+		unpack(values);
+		return values;
+	}
+
+}
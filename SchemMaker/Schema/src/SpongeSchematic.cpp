@@ -0,0 +1,459 @@
+#include "SpongeSchematic.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+
+#include "NBT_Document.h"
+#include "NBT_Endian.h"
+
+#ifdef NBT_SSE2
+#include <immintrin.h>
+#endif
+
+namespace Schema {
+
+	using namespace NBT;
+	using tag = NBT_Value::tag;
+
+	namespace {
+
+		template<std::unsigned_integral T>
+		T load_le(const uint8_t* p) noexcept {
+			T v;
+			std::memcpy(&v, p, sizeof(T));
+			if constexpr (std::endian::native == std::endian::big)
+				v = byteswap(v);
+			return v;
+		}
+
+		template<std::unsigned_integral T>
+		void store_le(uint8_t* p, T v) noexcept {
+			if constexpr (std::endian::native == std::endian::big)
+				v = byteswap(v);
+			std::memcpy(p, &v, sizeof(T));
+		}
+
+		[[noreturn]] void bad_block_data(const char* what) {
+			throw NBT_Exception(std::string("Bad Schematic: BlockData ") + what);
+		}
+
+		// One varint of any length at p; three bytes hold any 16 bit index.
+		uint32_t decode_one(const uint8_t*& p, const uint8_t* end) {
+			uint32_t v = 0;
+			if (end - p >= 4) {
+				uint32_t w = load_le<uint32_t>(p);
+				uint32_t stops = ~w & 0x808080u;
+				if (stops == 0)
+					bad_block_data("holds an index above 65535");
+				unsigned bytes = (std::countr_zero(stops) >> 3) + 1;
+				w &= 0xffffffu >> (24 - 8 * bytes);
+				v = (w & 0x7f) | ((w >> 1) & 0x3f80) | ((w >> 2) & 0x1fc000);
+				p += bytes;
+			}
+			else {
+				for (unsigned shift = 0;; shift += 7) {
+					if (p == end)
+						bad_block_data("is shorter than the schematic");
+					if (shift > 14)
+						bad_block_data("holds an index above 65535");
+					uint8_t b = *p++;
+					v |= uint32_t(b & 0x7f) << shift;
+					if (!(b & 0x80))
+						break;
+				}
+			}
+			if (v > 0xffff)
+				bad_block_data("holds an index above 65535");
+			return v;
+		}
+
+		// The SIMD loops below decode as far as they can and stop before a
+		// varint they leave to decode_one; maxima are kept in 16 bit lanes,
+		// none of which exceeds 16383.
+#ifdef NBT_SSE2
+
+		// One- and two-byte varints among 8 bytes, by the bytes' continuation
+		// bits: a pshufb control moving each varint into a 16 bit lane, how
+		// many there are and how many bytes they take. A longer varint, or
+		// one cut off by the end of the 8 bytes, ends the block.
+		struct varint_block {
+			int8_t shuffle[16];
+			uint8_t count;
+			uint8_t bytes;
+		};
+
+		constexpr std::array<varint_block, 256> make_varint_blocks() {
+			std::array<varint_block, 256> blocks{};
+			for (unsigned mask = 0; mask < 256; mask++) {
+				auto& block = blocks[mask];
+				for (auto& s : block.shuffle)
+					s = -1;
+				unsigned pos = 0, count = 0;
+				while (pos < 8) {
+					block.shuffle[2 * count] = static_cast<int8_t>(pos);
+					if (!(mask >> pos & 1))
+						pos += 1;
+					else if (pos + 1 < 8 && !(mask >> (pos + 1) & 1)) {
+						block.shuffle[2 * count + 1] = static_cast<int8_t>(pos + 1);
+						pos += 2;
+					}
+					else {
+						block.shuffle[2 * count] = -1;
+						break;
+					}
+					count++;
+				}
+				block.count = static_cast<uint8_t>(count);
+				block.bytes = static_cast<uint8_t>(pos);
+			}
+			return blocks;
+		}
+
+		constexpr auto varint_blocks = make_varint_blocks();
+
+		// Widens 16 one-byte varints.
+		inline void widen_16(__m128i b, uint16_t* o, __m128i& max) noexcept {
+			const __m128i zero = _mm_setzero_si128();
+			__m128i lo = _mm_unpacklo_epi8(b, zero);
+			__m128i hi = _mm_unpackhi_epi8(b, zero);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(o), lo);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(o + 8), hi);
+			max = _mm_max_epi16(max, _mm_max_epi16(lo, hi));
+		}
+
+		// Runs of one-byte varints only; stops at the first longer one.
+		void decode_runs_sse2(const uint8_t*& p, const uint8_t* end, uint16_t*& o, uint16_t* o_end, __m128i& max) noexcept {
+			while (end - p >= 16 && o_end - o >= 16) {
+				__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+				unsigned long_bytes = unsigned(_mm_movemask_epi8(b));
+				if (long_bytes == 0) {
+					widen_16(b, o, max);
+					p += 16;
+					o += 16;
+					continue;
+				}
+				// Keep the bytes before the longer varint; the rest are redone.
+				int n = std::countr_zero(long_bytes);
+				__m128i taken = _mm_cmplt_epi8(_mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15),
+					_mm_set1_epi8(static_cast<char>(n)));
+				widen_16(_mm_and_si128(b, taken), o, max);
+				p += n;
+				o += n;
+				return;
+			}
+		}
+
+		NBT_TARGET("ssse3")
+		void decode_blocks_ssse3(const uint8_t*& p, const uint8_t* end, uint16_t*& o, uint16_t* o_end, __m128i& max) noexcept {
+			const __m128i low = _mm_set1_epi16(0x007f);
+			const __m128i high = _mm_set1_epi16(0x3f80);
+			while (end - p >= 16 && o_end - o >= 16) {
+				__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+				unsigned long_bytes = unsigned(_mm_movemask_epi8(b));
+				if (long_bytes == 0) {
+					widen_16(b, o, max);
+					p += 16;
+					o += 16;
+					continue;
+				}
+				const auto& block = varint_blocks[long_bytes & 0xff];
+				if (block.count == 0)
+					return;
+				__m128i x = _mm_shuffle_epi8(b, _mm_loadu_si128(reinterpret_cast<const __m128i*>(block.shuffle)));
+				__m128i v = _mm_or_si128(_mm_and_si128(x, low), _mm_and_si128(_mm_srli_epi16(x, 1), high));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(o), v);
+				max = _mm_max_epi16(max, v);
+				p += block.bytes;
+				o += block.count;
+			}
+		}
+
+#else
+
+		// Runs of one-byte varints only, 8 at a time; stops at the first longer one.
+		void decode_runs_swar(const uint8_t*& p, const uint8_t* end, uint16_t*& o, uint16_t* o_end, uint32_t& max) noexcept {
+			while (end - p >= 8 && o_end - o >= 8) {
+				uint64_t w = load_le<uint64_t>(p);
+				uint64_t long_bytes = w & 0x8080808080808080ull;
+				int n = long_bytes ? std::countr_zero(long_bytes) >> 3 : 8;
+				for (int i = 0; i < n; i++) {
+					o[i] = static_cast<uint16_t>((w >> (8 * i)) & 0xff);
+					max = std::max<uint32_t>(max, o[i]);
+				}
+				p += n;
+				o += n;
+				if (n < 8)
+					return;
+			}
+		}
+
+#endif
+
+		template<bool Mapped>
+		uint8_t* encode_all(std::span<const uint16_t> in, const uint16_t* remap, uint8_t* q, uint8_t* q_end) {
+			size_t i = 0;
+			// The value's bytes, continuation bits set, go out in one 4 byte
+			// store; the cursor then moves by its length.
+			for (; i < in.size() && q_end - q >= 4; i++) {
+				uint32_t v = Mapped ? remap[in[i]] : in[i];
+				uint32_t two = v >= 0x80, three = v >= 0x4000;
+				store_le<uint32_t>(q, (v & 0x7f) | ((v << 1) & 0x7f00) | ((v << 2) & 0x7f0000) | two << 7 | three << 15);
+				q += 1 + two + three;
+			}
+			for (; i < in.size(); i++) {
+				uint32_t v = Mapped ? remap[in[i]] : in[i];
+				do {
+					if (q == q_end)
+						bad_block_data("buffer is too small");
+					*q++ = static_cast<uint8_t>((v & 0x7f) | (v >= 0x80 ? 0x80 : 0));
+					v >>= 7;
+				} while (v);
+			}
+			return q;
+		}
+
+		// Type-checked lookup; null if key is missing.
+		const NBT_Value* find_field(const Compound& c, std::string_view key, tag t) {
+			auto i = c.find(key);
+			if (i == c.end())
+				return nullptr;
+			if (i->second.get_tag() != t)
+				throw NBT_Exception("Bad Schematic: " + std::string(key) + " is " +
+					NBT_Value::tag_string(i->second.get_tag()) + ", not " + NBT_Value::tag_string(t));
+			return &i->second;
+		}
+
+		template<NBT_Type T>
+		const T* find_as(const Compound& c, std::string_view key) {
+			const NBT_Value* v = find_field(c, key, NBT_Value::tag_of<T>());
+			return v ? &v->get<T>() : nullptr;
+		}
+
+		template<NBT_Type T>
+		const T& field(const Compound& c, std::string_view key) {
+			if (auto v = find_as<T>(c, key))
+				return *v;
+			throw NBT_Exception("Bad Schematic: missing " + std::string(key));
+		}
+
+		// v1 and v2 files name their root "Schematic"; v3 wraps it in an
+		// unnamed root Compound.
+		const Compound& schematic_of(const NBT_Value& root) {
+			if (root.get_tag() != tag::TAG_Compound)
+				throw NBT_Exception("Bad Schematic: root is " + NBT_Value::tag_string(root.get_tag()));
+			const auto& top = root.get<Compound>();
+			if (auto s = find_as<Compound>(top, "Schematic"))
+				return *s;
+			if (auto wrapper = find_as<Compound>(top, ""))
+				if (auto s = find_as<Compound>(*wrapper, "Schematic"))
+					return *s;
+			throw NBT_Exception("Bad Schematic: missing Schematic");
+		}
+
+		std::vector<std::string> read_palette(const Compound& palette) {
+			std::vector<std::string> names;
+			for (auto& [name, index] : palette) {
+				if (index.get_tag() != tag::TAG_Int)
+					throw NBT_Exception("Bad Schematic: palette entry " + std::string(name.view()) + " is not an Int");
+				Int i = index.get<Int>();
+				if (i < 0 || i > 0xffff)
+					throw NBT_Exception("Bad Schematic: palette index " + std::to_string(i) + " out of range");
+				if (size_t(i) >= names.size())
+					names.resize(size_t(i) + 1);
+				if (!names[i].empty())
+					throw NBT_Exception("Bad Schematic: palette index " + std::to_string(i) + " used twice");
+				names[i] = name.view();
+			}
+			return names;
+		}
+
+	}
+
+	uint16_t decode_varints(std::span<const std::byte> in, std::span<uint16_t> out)
+	{
+		auto p = reinterpret_cast<const uint8_t*>(in.data());
+		const auto end = p + in.size();
+		auto o = out.data();
+		const auto o_end = o + out.size();
+		uint32_t max = 0;
+#ifdef NBT_SSE2
+		static const bool ssse3 = cpu_simd_level() >= simd_level::ssse3;
+		__m128i lane_max = _mm_setzero_si128();
+#endif
+		while (o != o_end) {
+#ifdef NBT_SSE2
+			if (ssse3)
+				decode_blocks_ssse3(p, end, o, o_end, lane_max);
+			else
+				decode_runs_sse2(p, end, o, o_end, lane_max);
+#else
+			decode_runs_swar(p, end, o, o_end, max);
+#endif
+			if (o == o_end)
+				break;
+			uint32_t v = decode_one(p, end);
+			max = std::max(max, v);
+			*o++ = static_cast<uint16_t>(v);
+		}
+		if (p != end)
+			bad_block_data("is longer than the schematic");
+#ifdef NBT_SSE2
+		lane_max = _mm_max_epi16(lane_max, _mm_srli_si128(lane_max, 8));
+		lane_max = _mm_max_epi16(lane_max, _mm_srli_si128(lane_max, 4));
+		lane_max = _mm_max_epi16(lane_max, _mm_srli_si128(lane_max, 2));
+		max = std::max<uint32_t>(max, _mm_cvtsi128_si32(lane_max) & 0xffff);
+#endif
+		return static_cast<uint16_t>(max);
+	}
+
+	size_t encode_varints(std::span<const uint16_t> in, std::span<const uint16_t> remap, std::span<std::byte> out)
+	{
+		auto q = reinterpret_cast<uint8_t*>(out.data());
+		auto q_end = q + out.size();
+		if (remap.empty())
+			return static_cast<size_t>(encode_all<false>(in, nullptr, q, q_end) - q);
+		// One pass up front keeps the check out of the loops below.
+		if (!in.empty() && *std::max_element(in.begin(), in.end()) >= remap.size())
+			bad_block_data("holds an index past the remap");
+		// A remap to below 128 (a palette of up to 128 used entries) makes
+		// every varint one byte: just a table lookup per block.
+		if (*std::max_element(remap.begin(), remap.end()) < 0x80) {
+			if (out.size() < in.size())
+				bad_block_data("buffer is too small");
+			for (size_t i = 0; i < in.size(); i++)
+				q[i] = static_cast<uint8_t>(remap[in[i]]);
+			return in.size();
+		}
+		return static_cast<size_t>(encode_all<true>(in, remap.data(), q, q_end) - q);
+	}
+
+	SpongeSchematic& SpongeSchematic::set_version(int version)
+	{
+		if (version < 1 || version > 3)
+			throw NBT_Exception("Bad Schematic: unknown Version " + std::to_string(version));
+		_version = version;
+		return *this;
+	}
+
+	SpongeSchematic SpongeSchematic::from_nbt(const NBT_Value& root)
+	{
+		const auto& s = schematic_of(root);
+		SpongeSchematic result;
+		result._version = field<Int>(s, "Version");
+		if (result._version < 1 || result._version > 3)
+			throw NBT_Exception("Bad Schematic: unknown Version " + std::to_string(result._version));
+		if (auto v = find_as<Int>(s, "DataVersion"))
+			result._data_version = *v;
+		if (auto v = find_as<Int_Array>(s, "Offset"); v && v->size() == 3)
+			std::copy(v->begin(), v->end(), result._offset.begin());
+		if (auto v = find_field(s, "Metadata", tag::TAG_Compound))
+			result._metadata = *v;
+
+		auto width = static_cast<unsigned short>(field<Short>(s, "Width"));
+		auto height = static_cast<unsigned short>(field<Short>(s, "Height"));
+		auto length = static_cast<unsigned short>(field<Short>(s, "Length"));
+
+		// v3 moved the block fields into Blocks and renamed BlockData to Data.
+		const auto& blocks = result._version == 3 ? field<Compound>(s, "Blocks") : s;
+		result._palette = read_palette(field<Compound>(blocks, "Palette"));
+		const auto& data = field<Byte_Array>(blocks, result._version == 3 ? "Data" : "BlockData");
+
+		std::vector<uint16_t> indices(size_t(width) * height * length);
+		auto max = decode_varints(std::as_bytes(std::span(data)), indices);
+		if (!indices.empty() && max >= result._palette.size())
+			throw NBT_Exception("Bad Schematic: block index " + std::to_string(max) + " is not in the palette");
+		result._blocks = AbstractBlockSpace<uint16_t>(std::move(indices), width, height, length);
+
+		if (auto v = find_field(blocks, result._version == 1 ? "TileEntities" : "BlockEntities", tag::TAG_List))
+			result._block_entities = *v;
+		return result;
+	}
+
+	SpongeSchematic SpongeSchematic::load(const std::filesystem::path& path, int state)
+	{
+		// The tree is only read from, so it goes into an arena and is
+		// dropped whole.
+		NBT_Document doc;
+		doc.set_state(state).load(path);
+		return from_nbt(doc.root());
+	}
+
+	NBT_Value SpongeSchematic::to_nbt() const
+	{
+		// Count the blocks of each index. Four tables in turn keep a run of
+		// one block from making each increment wait for the last.
+		const size_t entries = _palette.size();
+		const uint16_t* blocks = _blocks.data();
+		const size_t volume = _blocks.volume();
+		std::vector<uint64_t> counts(4 * entries);
+		auto count = [&](size_t table, uint16_t index) {
+			if (index >= entries)
+				throw NBT_Exception("Bad Schematic: block index " + std::to_string(index) + " is not in the palette");
+			counts[table * entries + index]++;
+		};
+		size_t i = 0;
+		for (; i + 4 <= volume; i += 4) {
+			count(0, blocks[i]);
+			count(1, blocks[i + 1]);
+			count(2, blocks[i + 2]);
+			count(3, blocks[i + 3]);
+		}
+		for (; i < volume; i++)
+			count(0, blocks[i]);
+		for (size_t table = 1; table < 4; table++)
+			for (size_t index = 0; index < entries; index++)
+				counts[index] += counts[table * entries + index];
+
+		// Used entries by falling count; the size of BlockData follows.
+		std::vector<uint16_t> order;
+		for (size_t index = 0; index < entries; index++)
+			if (counts[index])
+				order.push_back(static_cast<uint16_t>(index));
+		std::stable_sort(order.begin(), order.end(), [&](uint16_t a, uint16_t b) { return counts[a] > counts[b]; });
+		std::vector<uint16_t> remap(entries);
+		size_t bytes = 0;
+		for (size_t k = 0; k < order.size(); k++) {
+			remap[order[k]] = static_cast<uint16_t>(k);
+			bytes += counts[order[k]] * (1 + (k >= 0x80) + (k >= 0x4000));
+		}
+		Byte_Array data(bytes);
+		encode_varints({ blocks, volume }, remap, std::as_writable_bytes(std::span(data)));
+
+		// v3 wraps the schematic in an unnamed root and its block fields in
+		// Blocks; nothing is added to a Compound once a child is referenced.
+		NBT_Value root;
+		auto& s = _version == 3 ? root.emplace_compound("").emplace_compound("Schematic", 8) : root.emplace_compound("Schematic", 12);
+		s.emplace("Version", Int(_version));
+		if (_version > 1)
+			s.emplace("DataVersion", _data_version);
+		s.emplace("Width", static_cast<Short>(_blocks.width()));
+		s.emplace("Height", static_cast<Short>(_blocks.height()));
+		s.emplace("Length", static_cast<Short>(_blocks.length()));
+		s.emplace("Offset", Int_Array{ _offset[0], _offset[1], _offset[2] });
+		if (_metadata.get_tag() == tag::TAG_Compound)
+			s.emplace("Metadata", _metadata);
+		if (_version < 3)
+			s.emplace("PaletteMax", static_cast<Int>(order.size()));
+
+		auto& fields = _version == 3 ? s.emplace_compound("Blocks", 3) : s;
+		auto& palette = fields.emplace_compound("Palette", order.size()).get<Compound>();
+		for (size_t k = 0; k < order.size(); k++)
+			if (!palette.try_emplace(NBT_Key(_palette[order[k]]), static_cast<Int>(k)).second)
+				throw NBT_Exception("Bad Schematic: palette entry " + _palette[order[k]] + " appears twice");
+		fields.emplace(_version == 3 ? "Data" : "BlockData", std::move(data));
+		const char* entities = _version == 1 ? "TileEntities" : "BlockEntities";
+		if (_block_entities.get_tag() == tag::TAG_List)
+			fields.emplace(entities, _block_entities);
+		else
+			fields.emplace_list<Compound>(entities);
+		return root;
+	}
+
+	void SpongeSchematic::save(const std::filesystem::path& path, const NBT_DeflateOptions& options) const
+	{
+		to_nbt().set_state(NBT_Value::use_gz).save(path, options);
+	}
+
+}
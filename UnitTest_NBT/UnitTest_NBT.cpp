@@ -1,7 +1,21 @@
 ﻿#include "pch.h"
 #include "CppUnitTest.h"
 
+#include <cmath>
+#include <limits>
+#include <unordered_set>
+#include <utility>
+
 #include "../SchemMaker/NBT/include/NBT_Value.h"
+#include "../SchemMaker/NBT/include/NBT_Stream.h"
+#include "../SchemMaker/NBT/include/NBT_Events.h"
+#include "../SchemMaker/NBT/include/NBT_Document.h"
+#include "../SchemMaker/NBT/include/NBT_Literal.h"
+#include "../SchemMaker/NBT/include/NBT_Patch.h"
+#include "../SchemMaker/Schema/include/SpongeSchematic.h"
+#include "../SchemMaker/Schema/include/PackedBlockStorage.h"
+#include "../SchemMaker/Schema/include/SectionedBlockSpace.h"
+#include "../SchemMaker/Schema/include/BlockRegion.h"
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
@@ -15,6 +29,35 @@ namespace UnitTestNBT
 	{
 	public:
 		
+		//读写测试共用的树，root下各类标签各有一个
+		static NBT_Value sample_tree()
+		{
+			return NBT_Value{
+				"root"_tag << CMP{
+					"Width"_tag << 3_s,
+					"BlockData"_tag << NBT_Value{ 1_b,2_b,3_b },
+					"Entities"_tag << LIST{ "a", "b" },
+					"Metadata"_tag << CMP{ "id"_tag << "c" },
+					"Offset"_tag << NBT_Value{ 1_i,2_i,3_i }
+				}
+			};
+		}
+
+		//临时目录下的UnitTest_NBT_<name>
+		static std::filesystem::path temp_path(const std::string& name)
+		{
+			return std::filesystem::temp_directory_path() / ("UnitTest_NBT_" + name);
+		}
+
+		//按默认状态写入temp_path(name)，返回其路径
+		static std::filesystem::path write_temp(NBT_Value& nbt, const std::string& name)
+		{
+			auto path = temp_path(name);
+			std::ofstream fout(path, std::ios::binary);
+			fout << nbt;
+			return path;
+		}
+
 		TEST_METHOD(Test_Zlib)
 		{
 			Assert::IsNotNull(ZLIB_VERSION);
@@ -85,5 +128,1042 @@ namespace UnitTestNBT
 			Assert::AreEqual((int)nbt_long_array.get_element_tag(), (int)tag::TAG_Long);
 		}
 
+		TEST_METHOD(Test_Reader)
+		{
+			const unsigned char data[] = {
+				0x7f,
+				0x12, 0x34,
+				0xff, 0xff, 0xff, 0xfe,
+				0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08,
+				0x3f, 0x80, 0x00, 0x00,
+				0x00, 0x03, 'a', 'b', 'c'
+			};
+			NBT_Reader reader(data, sizeof(data));
+			Assert::AreEqual((int)reader.read<NBT::Byte>(), 0x7f);
+			Assert::AreEqual((int)reader.read<Short>(), 0x1234);
+			Assert::AreEqual(reader.read<Int>(), -2);
+			Assert::AreEqual(reader.read<Long>(), 0x0102030405060708LL);
+			Assert::AreEqual(reader.read<Float>(), 1.0f);
+			Assert::AreEqual(reader.read_string(), std::string("abc"));
+			Assert::AreEqual(reader.remaining(), (size_t)0);
+			Assert::ExpectException<NBT_Exception>([&] { reader.read<NBT::Byte>(); });
+		}
+
+		TEST_METHOD(Test_StreamReader)
+		{
+			//每次只产出一个字节的数据源，用于检查窗口的补充逻辑
+			struct trickle_source :public NBT_Source {
+				std::string data;
+				size_t pos = 0;
+				size_t pull(std::byte* dst, size_t n) override {
+					if (pos == data.size() || n == 0)
+						return 0;
+					*dst = (std::byte)data[pos++];
+					return 1;
+				}
+			} source;
+			std::string long_string(100, 'x');
+			source.data = std::string("\x12\x34\x56\x78", 4)
+				+ std::string("\x00\x64", 2) + long_string
+				+ std::string("\x00\x00\x00\x2a", 4);
+
+			NBT_Reader reader(source, 8);
+			Assert::AreEqual(reader.read<Int>(), 0x12345678);
+			Assert::AreEqual(reader.read_string(), long_string);
+			Assert::AreEqual(reader.read<Int>(), 42);
+			Assert::ExpectException<NBT_Exception>([&] { reader.read<NBT::Byte>(); });
+
+			//损坏的长度在数据用完时报错，不会按长度一次分配内存
+			auto path = temp_path("bad_length.nbt");
+			for (char t : { '\x07', '\x09', '\x0b', '\x0c' }) {
+				std::string bad = std::string("\x0a\x00\x00", 3) + t + std::string("\x00\x01" "a", 3)
+					+ (t == '\x09' ? std::string("\x0a", 1) : std::string()) + std::string("\x7f\xff\xff\xff\x00\x00", 6);
+				std::istringstream in(bad);
+				Assert::ExpectException<NBT_Exception>([&] { NBT_Value().read(in); });
+				{
+					std::ofstream fout(path, std::ios::binary);
+					fout.write(bad.data(), bad.size());
+				}
+				Assert::ExpectException<NBT_Exception>([&] { NBT_Value().load(path); });
+			}
+			std::filesystem::remove(path);
+		}
+
+		TEST_METHOD(Test_ByteswapArray)
+		{
+			//长度覆盖 SIMD 主循环与标量尾部
+			for (size_t n = 0; n < 100; n++) {
+				Long_Array longs(n);
+				Int_Array ints(n);
+				for (size_t i = 0; i < n; i++) {
+					longs[i] = (Long)(0x0102030405060708LL * (i + 1));
+					ints[i] = (Int)(0x01020304 * (i + 1));
+				}
+				auto longs_copy = longs;
+				auto ints_copy = ints;
+				byteswap_array(longs.data(), n, sizeof(Long));
+				byteswap_array(ints.data(), n, sizeof(Int));
+				for (size_t i = 0; i < n; i++) {
+					Assert::AreEqual(longs[i], byteswap(longs_copy[i]));
+					Assert::AreEqual(ints[i], byteswap(ints_copy[i]));
+				}
+			}
+		}
+
+		TEST_METHOD(Test_LazyLoad)
+		{
+			NBT_Value nbt = sample_tree();
+			auto path = write_temp(nbt, "lazy.nbt");
+
+			NBT_Value lazy;
+			lazy.set_state(NBT_Value::use_lazy).load(path);
+			auto& root = lazy["root"];
+			//未访问的子树只记录位置，类型仍可查询
+			Assert::AreEqual((int)root["Entities"].get_tag(), (int)tag::TAG_List);
+			Assert::AreEqual((int)root["Width"].get<Short>(), 3);
+			Assert::AreEqual(root["BlockData"].get<Byte_Array>().size(), (size_t)3);
+			Assert::AreEqual(root["Entities"][1].get<String>(), std::string("b"));
+			Assert::AreEqual(root["Metadata"]["id"].get<String>(), std::string("c"));
+			Assert::IsTrue(lazy == nbt);
+
+			std::filesystem::remove(path);
+		}
+
+		TEST_METHOD(Test_Events)
+		{
+			NBT_Value nbt = sample_tree();
+			auto path = write_temp(nbt, "events.nbt");
+
+			//记录事件序列，并跳过Metadata子树
+			struct recorder :public NBT_Handler {
+				using NBT_Handler::scalar;
+				using NBT_Handler::array;
+				std::string log;
+				Int sum = 0;
+				bool begin_compound(std::string_view name) {
+					log += "{" + std::string(name);
+					return name != "Metadata";
+				}
+				void end_compound() { log += "}"; }
+				bool begin_list(std::string_view name, tag, Int size) {
+					log += "[" + std::string(name) + std::to_string(size);
+					return true;
+				}
+				void end_list() { log += "]"; }
+				void scalar(tag, std::string_view name, Short value) { log += " " + std::string(name) + "=" + std::to_string(value); }
+				void string(std::string_view, std::string_view value) { log += " " + std::string(value); }
+				void array(tag, std::string_view name, std::span<const NBT::Byte> chunk, size_t) {
+					log += " " + std::string(name);
+					for (auto v : chunk)
+						sum += v;
+				}
+				void array(tag, std::string_view name, std::span<const Int> chunk, size_t) {
+					log += " " + std::string(name);
+					for (auto v : chunk)
+						sum += v;
+				}
+			} handler;
+			parse_events(path, handler);
+			Assert::AreEqual(handler.log, std::string("{root Width=3 BlockData[Entities2 a b]{Metadata Offset}"));
+			Assert::AreEqual(handler.sum, 12);
+
+			//空数组不产生array事件
+			NBT_Value empty{ "root"_tag << CMP{ "Empty"_tag << Int_Array{} } };
+			auto empty_path = write_temp(empty, "events_empty.nbt");
+			recorder empty_handler;
+			parse_events(empty_path, empty_handler);
+			Assert::AreEqual(empty_handler.log, std::string("{root}"));
+			std::filesystem::remove(empty_path);
+
+			std::filesystem::remove(path);
+		}
+
+		TEST_METHOD(Test_Document)
+		{
+			NBT_Value nbt = sample_tree();
+			auto path = write_temp(nbt, "document.nbt");
+
+			NBT_Document doc;
+			doc.load(path);
+			Assert::IsTrue(doc.root() == nbt);
+			//容器分配在文档的内存池中
+			auto& root = doc.root()["root"];
+			Assert::IsTrue(root.get<Compound>().get_allocator().resource() == doc.resource());
+			Assert::IsTrue(root["BlockData"].get<Byte_Array>().get_allocator().resource() == doc.resource());
+			//复制出的子树使用默认堆，可在文档销毁后继续使用
+			NBT_Value copy = root;
+			Assert::IsTrue(copy.get<Compound>().get_allocator().resource() == std::pmr::get_default_resource());
+
+			doc.load(path);
+			Assert::IsTrue(doc.root()["root"] == copy);
+			doc.clear();
+			Assert::AreEqual((int)doc.root().get_tag(), (int)tag::TAG_End);
+
+			//未解码的子树复制后同样不依赖文档
+			NBT_Value lazy_copy;
+			{
+				NBT_Document lazy_doc;
+				lazy_doc.set_state(NBT_Value::use_lazy).load(path);
+				lazy_copy = lazy_doc.root();
+			}
+			Assert::IsTrue(lazy_copy == nbt);
+			Assert::AreEqual(lazy_copy["root"]["Metadata"]["id"].get<String>(), std::string("c"));
+
+			//移走后的文档为空，可以再次读取
+			NBT_Document moved = std::move(doc);
+			doc.clear();
+			Assert::IsTrue(doc.resource() == std::pmr::get_default_resource());
+			doc.load(path);
+			Assert::IsTrue(doc.root() == nbt);
+
+			std::filesystem::remove(path);
+		}
+
+		TEST_METHOD(Test_ListStorage)
+		{
+			//数值列表以紧凑数组保存
+			NBT_Value pos{ 1.5_d, 2.5_d, 3.5_d };
+			auto& list = pos.get<List>();
+			Assert::AreEqual((int)pos.get_tag(), (int)tag::TAG_List);
+			Assert::AreEqual((int)pos.get_element_tag(), (int)tag::TAG_Double);
+			Assert::IsTrue(list.is_packed());
+			Assert::AreEqual(list.values<Double>()[2], 3.5);
+
+			//通过operator[]访问时展开为节点，values()重新压缩
+			pos[1] = 4.5_d;
+			Assert::IsFalse(list.is_packed());
+			Assert::ExpectException<NBT_Exception>([&] { pos[0] = "a"; });
+			Assert::AreEqual(list.values<Double>()[1], 4.5);
+			Assert::IsTrue(list.is_packed());
+			Assert::ExpectException<NBT_Exception>([&] { list.values<Int>(); });
+			Assert::ExpectException<NBT_Exception>([&] { list.push_back(NBT_Value(1_i)); });
+
+			NBT_Value names{ "a", "b" };
+			Assert::IsFalse(names.get<List>().is_packed());
+
+			//一侧已展开为节点时逐个元素比较
+			NBT_Value p1{ 1.5_d, 2.5_d }, p2{ 1.5_d, 2.5_d };
+			p2[0];
+			Assert::IsTrue(p1 == p2);
+			Assert::IsTrue(p2 == p1);
+			Assert::IsTrue(p1.get<List>().is_packed());
+			p2[1] = 3.5_d;
+			Assert::IsTrue(p1 < p2);
+			Assert::IsTrue(p2 > p1);
+			Assert::IsTrue(NBT_Value{ 1.5_d } < p2);
+
+			NBT_Value nbt{ "root"_tag << CMP{ "Pos"_tag << pos, "Names"_tag << names } };
+			auto path = write_temp(nbt, "list.nbt");
+			NBT_Value loaded;
+			loaded.load(path);
+			Assert::IsTrue(loaded["root"]["Pos"].get<List>().is_packed());
+			Assert::IsTrue(loaded == nbt);
+
+			std::filesystem::remove(path);
+		}
+
+		TEST_METHOD(Test_Compound)
+		{
+			//保持插入顺序，超过linear_limit后使用哈希索引
+			Compound cmp;
+			for (int i = 0; i < 100; i++)
+				cmp.insert_or_assign("minecraft:block_" + std::to_string(99 - i), i);
+			Assert::AreEqual(cmp.size(), (size_t)100);
+			Assert::IsTrue(cmp.begin()->first == "minecraft:block_99");
+			std::string_view key = "minecraft:block_42";
+			Assert::AreEqual(cmp.at(key).get<Int>(), 57);
+			Assert::IsTrue(cmp.find("minecraft:block_100") == cmp.end());
+			Assert::ExpectException<NBT_Exception>([&] { cmp.at("minecraft:stone"); });
+
+			//重复的键保留原位置
+			cmp.insert_or_assign("minecraft:block_99", 1000);
+			Assert::AreEqual(cmp.begin()->second.get<Int>(), 1000);
+			Assert::AreEqual(cmp.erase("minecraft:block_99"), (size_t)1);
+			Assert::IsFalse(cmp.contains("minecraft:block_99"));
+			Assert::AreEqual(cmp["minecraft:block_0"].get<Int>(), 99);
+
+			//相等比较与顺序无关
+			NBT_Value a{ "x"_tag << 1_i, "y"_tag << 2_i };
+			NBT_Value b{ "y"_tag << 2_i, "x"_tag << 1_i };
+			Assert::IsTrue(a == b);
+			b["x"] = 3_i;
+			Assert::IsFalse(a == b);
+		}
+
+		TEST_METHOD(Test_StringPool)
+		{
+			//相同的字符串只保存一份
+			NBT_StringPool pool;
+			auto k1 = pool.intern("minecraft:oak_stairs[facing=east,half=bottom]");
+			auto k2 = pool.intern(std::string("minecraft:oak_stairs[facing=east,half=bottom]"));
+			Assert::IsTrue(k1.interned());
+			Assert::IsTrue(k1.data() == k2.data());
+			Assert::AreEqual(pool.size(), (size_t)1);
+			Assert::IsTrue(k1.hash() == std::hash<std::string_view>{}(k1.view()));
+			//复制得到独立的键
+			NBT_Key copy = k1;
+			Assert::IsFalse(copy.interned());
+			Assert::IsTrue(copy == k1);
+
+			List entities;
+			entities.push_back(CMP{ "Id"_tag << "a" });
+			entities.push_back(CMP{ "Id"_tag << "b" });
+			NBT_Value nbt{
+				"root"_tag << CMP{
+					"Palette"_tag << CMP{ "minecraft:air"_tag << 0_i, "minecraft:stone"_tag << 1_i }
+				}
+			};
+			nbt["root"].add_tag("Entities", NBT_Value(entities));
+			auto path = write_temp(nbt, "pool.nbt");
+
+			//多个文档共享同一个字符串池
+			auto shared = std::make_shared<NBT_StringPool>();
+			NBT_Document d1, d2;
+			d1.set_string_pool(shared).load(path);
+			d2.set_string_pool(shared).load(path);
+			Assert::IsTrue(d1.root() == nbt);
+			Assert::AreEqual(shared->size(), (size_t)6);
+			auto& e1 = d1.root()["root"]["Entities"].get<List>()[0].get<Compound>();
+			auto& e2 = d2.root()["root"]["Entities"].get<List>()[1].get<Compound>();
+			Assert::IsTrue(e1.begin()->first.data() == e2.begin()->first.data());
+			Assert::AreEqual(e2.at("Id").get<String>(), std::string("b"));
+
+			//未解码的子树持有字符串池，解码时仍写入同一个池
+			auto lazy_pool = std::make_shared<NBT_StringPool>();
+			NBT_Value lazy;
+			lazy.set_state(NBT_Value::use_lazy).load(path, nullptr, lazy_pool);
+			Assert::IsTrue(lazy_pool.use_count() > 1);
+			Assert::IsTrue(lazy == nbt);
+			Assert::IsTrue(lazy["root"]["Entities"][0].get<Compound>().begin()->first.interned());
+			Assert::AreEqual(lazy_pool->size(), (size_t)6);
+
+			std::filesystem::remove(path);
+		}
+
+		TEST_METHOD(Test_Writer)
+		{
+			NBT_Value nbt{
+				"root"_tag << CMP{
+					"Width"_tag << 3_s,
+					"Pos"_tag << NBT_Value{ 1.5_d, 2.5_d, 3.5_d },
+					"BlockData"_tag << NBT_Value{ 1_b,2_b,3_b },
+					"Offset"_tag << NBT_Value{ 1_i, -2_i, 3_i },
+					"Name"_tag << "lupine"
+				}
+			};
+			//预先计算的长度与实际写出的字节数一致
+			auto bytes = nbt.to_binary();
+			Assert::AreEqual(bytes.size(), nbt.serialized_size());
+
+			//写入调用方提供的缓冲区
+			std::vector<std::byte> buffer(bytes.size() + 16);
+			Assert::AreEqual(nbt.write_binary(buffer), bytes.size());
+			Assert::IsTrue(std::equal(bytes.begin(), bytes.end(), buffer.begin()));
+			Assert::ExpectException<NBT_Exception>([&] {
+				nbt.write_binary(std::span<std::byte>(buffer.data(), bytes.size() - 1));
+				});
+
+			//写出的数据可以被读回
+			std::istringstream in(std::string(reinterpret_cast<const char*>(bytes.data()), bytes.size()));
+			NBT_Value back;
+			back.read(in);
+			Assert::IsTrue(back == nbt);
+		}
+
+		TEST_METHOD(Test_DeflateWriter)
+		{
+			Long_Array blocks(4096);
+			for (size_t i = 0; i < blocks.size(); i++)
+				blocks[i] = (Long)(i % 7);
+			NBT_Value nbt{
+				"root"_tag << CMP{
+					"Name"_tag << "lupine",
+					"Pos"_tag << NBT_Value{ 1.5_d, 2.5_d, 3.5_d }
+				}
+			};
+			nbt["root"].add_tag("BlockStates", NBT_Value(blocks));
+			auto bytes = nbt.to_binary();
+
+			//窗口很小时分块交给输出端，结果不变
+			std::ostringstream raw(std::ios::binary);
+			NBT_OstreamSink raw_sink(raw);
+			NBT_Writer writer(raw_sink, 8);
+			nbt.write(writer);
+			writer.flush();
+			Assert::AreEqual(writer.written(), bytes.size());
+			Assert::IsTrue(raw.str() == std::string(reinterpret_cast<const char*>(bytes.data()), bytes.size()));
+
+			//比元素还小的窗口会被放大，不会卡住
+			std::ostringstream tiny(std::ios::binary);
+			NBT_OstreamSink tiny_sink(tiny);
+			NBT_Writer tiny_writer(tiny_sink, 1);
+			nbt.write(tiny_writer);
+			tiny_writer.flush();
+			Assert::IsTrue(tiny.str() == raw.str());
+
+			//不同压缩等级与格式都能读回
+			auto round_trip = [&](int state, int level) {
+				std::stringstream ss(std::ios::in | std::ios::out | std::ios::binary);
+				nbt.set_state(state);
+				nbt.write(ss, { level, Z_DEFAULT_STRATEGY });
+				auto size = ss.str().size();
+				NBT_Value back;
+				back.set_state(state).read(ss);
+				Assert::IsTrue(back == nbt);
+				return size;
+			};
+			auto stored = round_trip(NBT_Value::use_gz, 0);
+			auto fast = round_trip(NBT_Value::use_gz, 1);
+			auto small = round_trip(NBT_Value::use_gz, 9);
+			Assert::IsTrue(stored > bytes.size());
+			Assert::IsTrue(small <= fast && fast < stored);
+			round_trip(NBT_Value::use_zip, 6);
+			nbt.unset_state(NBT_Value::use_gz | NBT_Value::use_zip);
+
+			//非法的压缩等级
+			std::ostringstream bad(std::ios::binary);
+			Assert::ExpectException<NBT_Exception>([&] {
+				NBT_DeflateSink sink(bad, NBT_Framing::gzip, { 10, Z_DEFAULT_STRATEGY });
+				});
+		}
+
+		TEST_METHOD(Test_ParallelDeflate)
+		{
+			//数据跨越多个压缩块
+			Long_Array blocks(64 * 1024);
+			for (size_t i = 0; i < blocks.size(); i++)
+				blocks[i] = (Long)(i * i % 1009);
+			NBT_Value nbt{ "root"_tag << CMP{ "Name"_tag << "lupine" } };
+			nbt["root"].add_tag("BlockStates", NBT_Value(blocks));
+			auto bytes = nbt.to_binary();
+			std::string raw(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+
+			NBT_DeflateOptions options;
+			options.threads = 4;
+			options.block_size = 32 * 1024;
+
+			//并行压缩的结果是单个完整的gzip成员
+			std::stringstream gz(std::ios::in | std::ios::out | std::ios::binary);
+			nbt.set_state(NBT_Value::use_gz).write(gz, options);
+			Assert::IsTrue(decompressString(gz.str()) == raw);
+			NBT_Value back;
+			back.set_state(NBT_Value::use_gz).read(gz);
+			Assert::IsTrue(back == nbt);
+
+			//zlib格式
+			std::stringstream zlib(std::ios::in | std::ios::out | std::ios::binary);
+			nbt.unset_state(NBT_Value::use_gz).set_state(NBT_Value::use_zip).write(zlib, options);
+			NBT_Value back_zlib;
+			back_zlib.set_state(NBT_Value::use_zip).read(zlib);
+			Assert::IsTrue(back_zlib == nbt);
+		}
+
+		TEST_METHOD(Test_ToString)
+		{
+			NBT_Value nbt{
+				"root"_tag << CMP{
+					"Width"_tag << 3_s,
+					"Pos"_tag << NBT_Value{ 1.5_d, -2.0_d },
+					"Name"_tag << "say \"hi\"",
+					"Data"_tag << NBT_Value{ 1_b,2_b }
+				}
+			};
+			auto& root = nbt["root"];
+			root.add_tag("minecraft:stone", NBT_Value(1_i));
+			//空容器不再崩溃
+			root.add_tag("Empty", NBT_Value(Compound()));
+			root.add_tag("Ints", NBT_Value(Int_Array()));
+			root.add_tag("Longs", NBT_Value(Long_Array{ 7 }));
+
+			Assert::AreEqual(nbt.to_string(),
+				std::string(R"({root:{Width:3s,Pos:[1.5d,-2d],Name:"say \"hi\"",Data:[B;1b,2b],"minecraft:stone":1,Empty:{},Ints:[I;],Longs:[L;7L]}})"));
+			Assert::AreEqual(nbt.to_string(NBT_Value::json_str),
+				std::string(R"({"root":{"Width":3,"Pos":[1.5,-2],"Name":"say \"hi\"","Data":[1,2],"minecraft:stone":1,"Empty":{},"Ints":[],"Longs":[7]}})"));
+
+			auto tree = root.to_string(NBT_Value::tree_str);
+			Assert::IsTrue(tree.starts_with("TAG_Compound(None): 8 entries\n{\n  TAG_Short('Width'): 3\n  TAG_List('Pos'): 2 entries\n  {\n    TAG_Double(None): 1.5\n"));
+			Assert::IsTrue(tree.find("  TAG_Byte_Array('Data'): [2 bytes]\n") != std::string::npos);
+
+			//流式输出与to_string一致，格式也可以由状态位决定
+			std::ostringstream os;
+			nbt.set_state(NBT_Value::json_str).print(os);
+			Assert::AreEqual(os.str(), nbt.to_string(NBT_Value::json_str));
+		}
+
+		TEST_METHOD(Test_Snbt)
+		{
+			auto v = parse_snbt(R"( { Name:"minecraft:stone", Count : 1b, 'quoted key':'it\'s',
+				Pos:[1.5d,-2d,3.0], Scale:0.5f, Age:-3s, Time:12345678901L, Flag:true, Plain:stone,
+				Data:[B;1b,2B,-3b], Heights:[I;1,-2], States:[L;5L,6l], Empty:[], Nested:{} } )");
+			auto& cmp = v.get<Compound>();
+			Assert::AreEqual(cmp.at("Name").get<String>(), std::string("minecraft:stone"));
+			Assert::AreEqual((int)cmp.at("Count").get<NBT::Byte>(), 1);
+			Assert::AreEqual(cmp.at("quoted key").get<String>(), std::string("it's"));
+			Assert::AreEqual((int)cmp.at("Pos").get_element_tag(), (int)tag::TAG_Double);
+			Assert::AreEqual(cmp.at("Scale").get<Float>(), 0.5f);
+			Assert::AreEqual((int)cmp.at("Age").get<Short>(), -3);
+			Assert::AreEqual(cmp.at("Time").get<Long>(), 12345678901LL);
+			Assert::AreEqual((int)cmp.at("Flag").get<NBT::Byte>(), 1);
+			Assert::AreEqual(cmp.at("Plain").get<String>(), std::string("stone"));
+			Assert::AreEqual((int)cmp.at("Data").get<Byte_Array>()[2], -3);
+			Assert::AreEqual(cmp.at("Heights").get<Int_Array>()[1], -2);
+			Assert::AreEqual(cmp.at("States").get<Long_Array>()[1], 6LL);
+			Assert::AreEqual((int)cmp.at("Empty").get_tag(), (int)tag::TAG_List);
+			Assert::IsTrue(cmp.at("Nested").get<Compound>().empty());
+
+			//与to_string互为逆操作
+			Assert::IsTrue(parse_snbt(v.to_string()) == v);
+			Assert::IsTrue("{id:\"minecraft:chest\",Items:[{Slot:0b,Count:64b}]}"_snbt
+				== parse_snbt(R"({Items:[{Count:64b,Slot:0b}],id:'minecraft:chest'})"));
+
+			//非有限浮点数也能往返
+			NBT_Value special{ std::numeric_limits<Float>::infinity(), -std::numeric_limits<Float>::infinity(),
+				std::numeric_limits<Float>::quiet_NaN() };
+			Assert::AreEqual(special.to_string(), std::string("[inff,-inff,nanf]"));
+			auto back = parse_snbt(special.to_string());
+			Assert::AreEqual(back[0].get<Float>(), std::numeric_limits<Float>::infinity());
+			Assert::AreEqual(back[1].get<Float>(), -std::numeric_limits<Float>::infinity());
+			Assert::IsTrue(std::isnan(back[2].get<Float>()));
+			Assert::AreEqual(NBT_Value(-std::numeric_limits<Double>::quiet_NaN()).to_string(), std::string("nand"));
+			Assert::IsTrue(std::isinf(parse_snbt("-infd").get<Double>()));
+			Assert::AreEqual((int)parse_snbt("inf").get_tag(), (int)tag::TAG_String);
+
+			Assert::ExpectException<NBT_Exception>([] { parse_snbt("{a:1"); });
+			Assert::ExpectException<NBT_Exception>([] { parse_snbt("{a:1}}"); });
+			Assert::ExpectException<NBT_Exception>([] { parse_snbt("[I;1,x]"); });
+			Assert::ExpectException<NBT_Exception>([] { parse_snbt("[1,\"a\"]"); });
+		}
+
+		TEST_METHOD(Test_Patch)
+		{
+			auto base = parse_snbt(R"({Name:"a",Pos:[1d,2d,3d],Items:[{Slot:0b},{Slot:1b}],Old:1,
+				Heights:[I;1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16,17,18,19,20],States:[L;1L,2L,3L]})");
+			auto target = parse_snbt(R"({Name:"b",Pos:[1d,5d,3d],Items:[{Slot:0b},{Slot:2b,Count:3b}],New:2s,
+				Heights:[I;1,0,3,4,5,6,7,8,9,10,11,12,13,14,15,16,17,18,0,20],States:[L;1L,7L,7L,3L]})");
+
+			auto patch = NBT_Patch::diff(base, target);
+			Assert::IsTrue(NBT_Patch::diff(base, base).empty());
+
+			//相隔较远的两处改动分成两段，不整段重写
+			size_t splices = 0;
+			for (auto& op : patch.operations())
+				if (op.kind == NBT_Patch::op_kind::splice && std::get<String>(op.path.back()) == "Heights")
+					splices++;
+			Assert::AreEqual(splices, (size_t)2);
+
+			auto bytes = patch.to_binary();
+			Assert::AreEqual(bytes.size(), patch.serialized_size());
+			Assert::IsTrue(bytes.size() < target.serialized_size());
+
+			auto patched = base;
+			NBT_Patch::from_binary(bytes).apply(patched);
+			Assert::IsTrue(patched == target);
+
+			//基准不匹配时报错
+			auto other = parse_snbt("{Name:\"a\"}");
+			Assert::ExpectException<NBT_Exception>([&] { patch.apply(other); });
+		}
+
+		TEST_METHOD(Test_Hash)
+		{
+			auto a = parse_snbt("{id:\"minecraft:chest\",Items:[{Slot:0b,Count:64b}],Pos:[1d,2d,3d],Data:[I;1,2,3]}");
+			auto b = parse_snbt("{Data:[I;1,2,3],Pos:[1d,2d,3d],Items:[{Count:64b,Slot:0b}],id:\"minecraft:chest\"}");
+			//与顺序、List存储方式无关
+			Assert::AreEqual(a.hash(), b.hash());
+			b["Pos"][0];
+			Assert::AreEqual(a.hash(), b.hash());
+			Assert::AreNotEqual(NBT_Value(1_b).hash(), NBT_Value(1_s).hash());
+			Assert::AreEqual(NBT_Value(0.0_d).hash(), NBT_Value(-0.0_d).hash());
+
+			//修改后缓存失效
+			auto h = a.hash();
+			a["Items"][0]["Count"] = 1_b;
+			Assert::AreNotEqual(a.hash(), h);
+			Assert::IsFalse(a == b);
+			a["Items"][0]["Count"] = 64_b;
+			Assert::AreEqual(a.hash(), h);
+			Assert::IsTrue(a == b);
+
+			std::unordered_set<NBT_Value> unique{ a, b, parse_snbt("{id:\"minecraft:furnace\"}") };
+			Assert::AreEqual(unique.size(), (size_t)2);
+
+			//通过先前取得的引用修改子节点后，哈希仍与==一致
+			auto c = parse_snbt("{X:{Y:1}}");
+			auto d = parse_snbt("{X:{Y:2}}");
+			auto& x = c["X"];
+			c.hash();
+			d.hash();
+			x["Y"] = 2;
+			Assert::IsTrue(c == d);
+			Assert::AreEqual(c.hash(), d.hash());
+			Assert::AreEqual(NBT_Patch::diff(c, d).size(), (size_t)0);
+			Assert::AreEqual(std::unordered_set<NBT_Value>{ c, d }.size(), (size_t)1);
+
+			//use_cow共享的内容不再改变，其哈希只算一次，==据此快速判断不等
+			auto e = parse_snbt("{X:{Y:1}}");
+			auto f = parse_snbt("{X:{Y:3}}");
+			e.set_state(NBT_Value::use_cow);
+			f.set_state(NBT_Value::use_cow);
+			NBT_Value e2 = e;
+			Assert::AreEqual(e2.hash(), e.hash());
+			f.hash();
+			Assert::IsFalse(e2 == f);
+			e2["X"]["Y"] = 3;
+			Assert::IsTrue(e2 == f);
+			Assert::AreEqual(e2.hash(), f.hash());
+			Assert::AreNotEqual(e.hash(), e2.hash());
+		}
+
+		TEST_METHOD(Test_CopyOnWrite)
+		{
+			auto base = parse_snbt(R"({Schematic:{Width:2s,BlockData:[B;0b,1b,2b,3b],
+				BlockEntities:[{Id:"minecraft:chest",Pos:[I;0,0,0]},{Id:"minecraft:sign",Pos:[I;1,0,0]}]}})");
+			auto original = base;
+			base.set_state(NBT_Value::use_cow);
+			//只读访问不会解除共享
+			auto block_data = [](const NBT_Value& v) {
+				return v.get<Compound>().at("Schematic").get<Compound>().at("BlockData").get<Byte_Array>().data();
+			};
+
+			NBT_Value stamp = base;
+			Assert::IsTrue(stamp.if_use_cow());
+			Assert::IsTrue(block_data(stamp) == block_data(base));
+
+			//修改只复制路径上的一层，其余子树仍然共享
+			stamp["Schematic"]["BlockEntities"][1]["Id"] = "minecraft:oak_sign";
+			Assert::IsTrue(block_data(stamp) == block_data(base));
+			Assert::IsTrue(base == original);
+			Assert::AreEqual(stamp["Schematic"]["BlockEntities"][1]["Id"].get<String>(), std::string("minecraft:oak_sign"));
+			Assert::AreEqual(NBT_Patch::diff(base, stamp).size(), (size_t)1);
+
+			stamp["Schematic"]["BlockData"][2_B] = 9_b;
+			Assert::IsFalse(block_data(stamp) == block_data(base));
+			Assert::AreEqual((int)block_data(base)[2], 2);
+			Assert::AreEqual((int)block_data(stamp)[2], 9);
+
+			//共享的子树照常序列化
+			Assert::IsTrue(NBT_Value(base).to_binary() == original.to_binary());
+
+			//复制const值不改动它，之前取得的引用仍然有效
+			const NBT_Value& cv = stamp;
+			const Compound& c = cv.get<Compound>();
+			NBT_Value from_const = cv;
+			Assert::AreEqual(c.size(), (size_t)1);
+			stamp["Schematic"]["Width"] = 3_s;
+			const Compound& edited = cv.get<Compound>().at("Schematic").get<Compound>();
+			NBT_Value deep = cv;
+			Assert::AreEqual(edited.size(), (size_t)3);
+			Assert::IsTrue(deep == stamp);
+			Assert::IsFalse(deep == from_const);
+		}
+
+		TEST_METHOD(Test_Builder)
+		{
+			NBT_Value root;
+			auto& schematic = root.emplace_compound("Schematic", 4);
+			schematic.emplace("Width", 2_s).get<Short>();
+			schematic.emplace_list<Double>("Offset", 3).emplace_back(1.5_d).emplace_back(0.0_d).emplace_back(-2.0_d);
+			auto& entities = schematic.emplace_list<Compound>("BlockEntities", 2);
+			for (Int i = 0; i < 2; i++) {
+				auto& entity = entities.emplace_back_compound(2);
+				entity.emplace("Id", "minecraft:chest");
+				entity.emplace("Pos", Int_Array{ i, 0, 0 });
+			}
+			//已有的键保持不变
+			schematic.emplace("Width", 9_s);
+
+			auto expected = parse_snbt(R"({Schematic:{Width:2s,Offset:[1.5d,0d,-2d],
+				BlockEntities:[{Id:"minecraft:chest",Pos:[I;0,0,0]},{Id:"minecraft:chest",Pos:[I;1,0,0]}]}})");
+			Assert::IsTrue(root == expected);
+			Assert::IsTrue(std::as_const(root).get<Compound>().at("Schematic").get<Compound>().at("Offset").get<List>().is_packed());
+
+			//右值构造，每个值只移动一次
+			auto made = NBT_Value::make_compound(
+				"Id"_tag << "minecraft:chest",
+				"Items"_tag << NBT_Value::make_list<Compound>(
+					NBT_Value::make_compound("Slot"_tag << 0_b, "Count"_tag << 64_b)),
+				"Pos"_tag << NBT_Value::make_list<Int>(1, 2, 3));
+			Assert::IsTrue(made == parse_snbt("{Id:\"minecraft:chest\",Items:[{Slot:0b,Count:64b}],Pos:[1,2,3]}"));
+
+			Assert::ExpectException<NBT_Exception>([] { NBT_Value(1).emplace("a", 1); });
+			Assert::ExpectException<NBT_Exception>([] { NBT_Value::make_list<Int>(1, 2_b); });
+
+			//各构造函数都不带状态位
+			NBT_Value fresh[] = {
+				NBT_Value(), NBT_Value(1_i), NBT_Value("a"), NBT_Value{ 1_i,2_i }, NBT_Value{ "a", "b" },
+				NBT_Value{ "Id"_tag << "minecraft:chest" }, NBT_Value::make_compound("Id"_tag << "minecraft:chest")
+			};
+			for (auto& v : fresh)
+				Assert::IsFalse(v.if_use_gz() || v.if_use_zip() || v.if_use_lazy() || v.if_use_cow());
+		}
+
+		TEST_METHOD(Test_SpongeLoad)
+		{
+			auto encode = [](std::span<const uint16_t> values) {
+				Byte_Array bytes;
+				for (uint32_t v : values) {
+					for (; v >= 0x80; v >>= 7)
+						bytes.push_back(static_cast<NBT::Byte>(v | 0x80));
+					bytes.push_back(static_cast<NBT::Byte>(v));
+				}
+				return bytes;
+			};
+
+			//单字节、双字节、三字节变长整数混合
+			std::vector<uint16_t> values = { 0, 1, 127, 128, 300, 16383, 16384, 65535 };
+			for (uint16_t i = 0; i < 40; i++)
+				values.push_back(i % 3 ? i : 200 + i);
+			auto bytes = encode(values);
+			std::vector<uint16_t> decoded(values.size());
+			Assert::AreEqual((int)Schema::decode_varints(std::as_bytes(std::span(bytes)), decoded), 65535);
+			Assert::IsTrue(decoded == values);
+			Assert::ExpectException<NBT_Exception>([&] {
+				Schema::decode_varints(std::as_bytes(std::span(bytes).first(bytes.size() - 1)), decoded); });
+			Assert::ExpectException<NBT_Exception>([&] {
+				Schema::decode_varints(std::as_bytes(std::span(bytes)), std::span(decoded).first(decoded.size() - 1)); });
+
+			//6x5x7，调色板有300项，索引x + z * 6 + y * 42
+			std::vector<uint16_t> blocks(6 * 5 * 7);
+			for (size_t i = 0; i < blocks.size(); i++)
+				blocks[i] = static_cast<uint16_t>(i < 100 ? i % 8 : i % 300);
+			NBT_Value palette;
+			for (Int i = 0; i < 300; i++)
+				palette.emplace("minecraft:block_" + std::to_string(i), i);
+
+			NBT_Value v2;
+			auto& s2 = v2.emplace_compound("Schematic");
+			s2.emplace("Version", 2);
+			s2.emplace("DataVersion", 3218);
+			s2.emplace("Width", 6_s);
+			s2.emplace("Height", 5_s);
+			s2.emplace("Length", 7_s);
+			s2.emplace("Offset", Int_Array{ -2, -1, -5 });
+			s2.emplace("PaletteMax", 300);
+			s2.emplace("Palette", palette);
+			s2.emplace("BlockData", encode(blocks));
+			s2.emplace_list<Compound>("BlockEntities").emplace_back_compound().emplace("Id", "minecraft:chest");
+
+			auto path = temp_path("sponge.schem");
+			v2.set_state(NBT_Value::use_gz).save(path);
+			auto schem = Schema::SpongeSchematic::load(path);
+			std::filesystem::remove(path);
+
+			Assert::AreEqual(schem.version(), 2);
+			Assert::AreEqual(schem.data_version(), 3218);
+			Assert::AreEqual(schem.offset()[2], -5);
+			Assert::AreEqual(schem.palette().size(), (size_t)300);
+			Assert::IsTrue(schem.blocks().blocks() == blocks);
+			Assert::AreEqual((int)schem.blocks().at(5, 4, 6), (int)blocks.back());
+			Assert::AreEqual(schem.block_at(2, 3, 1), std::string("minecraft:block_") + std::to_string(blocks[2 + 6 + 3 * 42]));
+			Assert::AreEqual(schem.block_entities().get<List>().size(), (size_t)1);
+
+			//v3：外层无名根，方块字段移入Blocks
+			NBT_Value v3;
+			auto& s3 = v3.emplace_compound("").emplace_compound("Schematic");
+			s3.emplace("Version", 3);
+			s3.emplace("Width", 6_s);
+			s3.emplace("Height", 5_s);
+			s3.emplace("Length", 7_s);
+			auto& b3 = s3.emplace_compound("Blocks");
+			b3.emplace("Palette", palette);
+			b3.emplace("Data", encode(blocks));
+			auto schem3 = Schema::SpongeSchematic::from_nbt(v3);
+			Assert::AreEqual(schem3.version(), 3);
+			Assert::IsTrue(schem3.blocks().blocks() == blocks);
+
+			//调色板之外的索引
+			palette.get<Compound>().erase("minecraft:block_299");
+			palette.emplace("minecraft:air", 0);
+			b3["Palette"] = palette;
+			Assert::ExpectException<NBT_Exception>([&] { Schema::SpongeSchematic::from_nbt(v3); });
+		}
+
+		TEST_METHOD(Test_SpongeSave)
+		{
+			std::vector<uint16_t> values;
+			for (uint32_t i = 0; i < 70000; i += 97)
+				values.push_back(static_cast<uint16_t>(i));
+			std::vector<std::byte> bytes(values.size() * 3);
+			bytes.resize(Schema::encode_varints(values, {}, bytes));
+			std::vector<uint16_t> decoded(values.size());
+			Schema::decode_varints(bytes, decoded);
+			Assert::IsTrue(decoded == values);
+			//缓冲区不足
+			Assert::ExpectException<NBT_Exception>([&] {
+				Schema::encode_varints(values, {}, std::span(bytes).first(bytes.size() - 1)); });
+			//值超出重映射表
+			std::vector<uint16_t> remap(values.size(), 1);
+			Assert::ExpectException<NBT_Exception>([&] { Schema::encode_varints(values, remap, bytes); });
+
+			//调色板：0号空气未使用，石头最多，另有200种方块各一个
+			std::vector<std::string> palette = { "minecraft:air", "minecraft:dirt", "minecraft:stone" };
+			for (int i = 0; i < 200; i++)
+				palette.push_back("minecraft:block_" + std::to_string(i));
+			Schema::AbstractBlockSpace<uint16_t> space(10, 10, 10, 2);
+			for (unsigned short x = 0; x < 10; x++)
+				for (unsigned short z = 0; z < 10; z++)
+					space.at(x, 0, z) = 1;
+			for (uint16_t i = 0; i < 200; i++)
+				space.at(i % 10, 1 + i / 100, i / 10 % 10) = 3 + i;
+
+			Schema::SpongeSchematic schem(space, palette);
+			schem.set_data_version(3218).set_offset({ 1, 2, 3 });
+			schem.block_entities().emplace_back_compound().emplace("Id", "minecraft:chest");
+			auto path = temp_path("sponge_save.schem");
+			schem.save(path);
+			auto loaded = Schema::SpongeSchematic::load(path);
+			std::filesystem::remove(path);
+
+			//未使用的空气被丢弃，按数量重新编号
+			Assert::AreEqual(loaded.palette().size(), (size_t)202);
+			Assert::AreEqual(loaded.palette()[0], std::string("minecraft:stone"));
+			Assert::AreEqual(loaded.palette()[1], std::string("minecraft:dirt"));
+			Assert::AreEqual(loaded.data_version(), 3218);
+			Assert::AreEqual(loaded.offset()[1], 2);
+			Assert::AreEqual(loaded.block_entities().get<List>().size(), (size_t)1);
+			for (unsigned short x = 0; x < 10; x++)
+				for (unsigned short y = 0; y < 10; y++)
+					for (unsigned short z = 0; z < 10; z++)
+						Assert::AreEqual(loaded.block_at(x, y, z), schem.block_at(x, y, z));
+
+			//v3布局
+			schem.set_version(3);
+			auto v3 = schem.to_nbt();
+			Assert::IsTrue(v3[""]["Schematic"]["Blocks"].get<Compound>().contains("Data"));
+			auto reread = Schema::SpongeSchematic::from_nbt(v3);
+			Assert::AreEqual(reread.version(), 3);
+			Assert::AreEqual(reread.block_at(3, 1, 0), schem.block_at(3, 1, 0));
+
+			schem.blocks().at(0, 0, 0) = 203;
+			Assert::ExpectException<NBT_Exception>([&] { schem.to_nbt(); });
+			Assert::ExpectException<NBT_Exception>([&] { schem.set_version(4); });
+		}
+
+		TEST_METHOD(Test_PackedStorage)
+		{
+			using Schema::PackedBlockStorage;
+			using layout = PackedBlockStorage::layout;
+			Assert::AreEqual(PackedBlockStorage::bits_for(1), 1u);
+			Assert::AreEqual(PackedBlockStorage::bits_for(17), 5u);
+			Assert::AreEqual(PackedBlockStorage::bits_for(17, 4), 5u);
+			Assert::AreEqual(PackedBlockStorage::bits_for(2, 4), 4u);
+			//Anvil区段：4096个5位，每个long放12个
+			Assert::AreEqual(PackedBlockStorage::words_for(4096, 5, layout::aligned), (size_t)342);
+			Assert::AreEqual(PackedBlockStorage::words_for(4096, 5, layout::spanning), (size_t)320);
+
+			//各位宽两种布局往返，起点不对齐
+			for (unsigned bits = 1; bits <= 16; bits++) {
+				for (auto l : { layout::aligned, layout::spanning }) {
+					std::vector<uint16_t> values(1000);
+					for (size_t i = 0; i < values.size(); i++)
+						values[i] = static_cast<uint16_t>((i * 2654435761u >> 7) & ((1u << bits) - 1));
+					PackedBlockStorage storage(values.size(), bits, l);
+					storage.pack(std::span(values).subspan(3), 3);
+					storage.pack(std::span(values).first(3));
+					Assert::AreEqual(storage.bits(), bits);
+					Assert::IsTrue(storage.unpack() == values);
+					std::vector<uint16_t> part(555);
+					storage.unpack(part, 77);
+					for (size_t i = 0; i < part.size(); i++)
+						Assert::AreEqual(part[i], values[77 + i]);
+					for (size_t i = 0; i < values.size(); i += 7)
+						Assert::AreEqual(storage[i], values[i]);
+
+					auto longs = storage.to_long_array();
+					Assert::AreEqual(longs.size(), PackedBlockStorage::words_for(values.size(), bits, l));
+					auto copy = PackedBlockStorage::from_long_array(longs, values.size(), bits, l);
+					Assert::IsTrue(copy.unpack() == values);
+				}
+			}
+
+			//单个读写不影响相邻项
+			PackedBlockStorage storage(100, 5, layout::spanning);
+			storage[12] = 31;
+			storage.set(13, 7);
+			Assert::AreEqual(storage.get(11), (uint16_t)0);
+			Assert::AreEqual(storage.get(12), (uint16_t)31);
+			Assert::AreEqual((uint16_t)storage[13], (uint16_t)7);
+			Assert::AreEqual(storage.get(14), (uint16_t)0);
+
+			//放不下时自动加宽
+			storage.set(50, 1000);
+			Assert::AreEqual(storage.bits(), 10u);
+			Assert::AreEqual(storage.get(12), (uint16_t)31);
+			Assert::AreEqual(storage.get(50), (uint16_t)1000);
+			storage.pack(std::vector<uint16_t>{ 1, 65535 }, 98);
+			Assert::AreEqual(storage.bits(), 16u);
+			Assert::AreEqual(storage.get(13), (uint16_t)7);
+			Assert::AreEqual(storage.get(99), (uint16_t)65535);
+
+			//按最大值选位宽
+			std::vector<uint16_t> small = { 0, 3, 2, 1 };
+			Assert::AreEqual(PackedBlockStorage(small).bits(), 2u);
+			Assert::AreEqual(PackedBlockStorage(small, 4).bits(), 4u);
+
+			Assert::ExpectException<NBT_Exception>([] { PackedBlockStorage(10, 17); });
+			Assert::ExpectException<NBT_Exception>([] {
+				PackedBlockStorage::from_long_array(Long_Array(3), 100, 4, layout::aligned); });
+			Assert::ExpectException<NBT_Exception>([&] { std::vector<uint16_t> out(2); storage.unpack(out, 99); });
+
+			//作为方块空间的存储
+			Schema::AbstractBlockSpace<uint16_t, PackedBlockStorage> space(PackedBlockStorage(4 * 3 * 2, 2), 4, 3, 2);
+			Assert::IsTrue(space.is_legal());
+			space.at(3, 2, 1) = 3;
+			space.at(1, 0, 1) = 9;
+			Assert::AreEqual((uint16_t)space.at(3, 2, 1), (uint16_t)3);
+			Assert::AreEqual((uint16_t)space.at(1, 0, 1), (uint16_t)9);
+			Assert::AreEqual(space.blocks().bits(), 4u);
+			Assert::AreEqual(space.blocks().get(space.index(3, 2, 1)), (uint16_t)3);
+		}
+
+		TEST_METHOD(Test_SectionedSpace)
+		{
+			using Schema::SectionedBlockSpace;
+			//超过65535的轴，全是空气时不分配区段
+			SectionedBlockSpace<uint16_t> huge(100000, 384, 70);
+			Assert::AreEqual(huge.sections_x(), 6250u);
+			Assert::AreEqual(huge.sections_y(), 24u);
+			Assert::AreEqual(huge.sections_z(), 5u);
+			Assert::AreEqual(huge.allocated_sections(), (size_t)0);
+			Assert::AreEqual(huge.at(99999, 383, 69), (uint16_t)0);
+			huge.set(99999, 383, 69, 7);
+			huge.set(70000, 0, 5, 0);
+			Assert::AreEqual(huge.allocated_sections(), (size_t)1);
+			Assert::AreEqual(huge.at(99999, 383, 69), (uint16_t)7);
+			Assert::AreEqual(huge.at(99998, 383, 69), (uint16_t)0);
+			//每个空区段只占一个指针
+			Assert::IsTrue(huge.memory_usage() < 6250 * 24 * 5 * 8 + 1000);
+
+			//区段内调色板与位宽增长
+			SectionedBlockSpace<std::string> space(40, 20, 30, "minecraft:air");
+			for (uint32_t i = 0; i < 20; i++)
+				space.set(i, 17, 3, "minecraft:block_" + std::to_string(i));
+			auto section = space.section_at(0, 17, 3);
+			Assert::AreEqual(section->palette().size(), (size_t)17);
+			Assert::AreEqual(section->indices().bits(), 5u);
+			Assert::AreEqual(space.at(19, 17, 3), std::string("minecraft:block_19"));
+			Assert::AreEqual(space.at(19, 16, 3), std::string("minecraft:air"));
+
+			//只有一种方块的区段不存索引
+			for (uint32_t x = 16; x < 32; x++)
+				for (uint32_t y = 0; y < 16; y++)
+					for (uint32_t z = 0; z < 16; z++)
+						space.set(x, y, z, "minecraft:stone");
+			space.compact();
+			Assert::IsTrue(space.section_at(16, 0, 0)->is_uniform());
+			Assert::AreEqual(space.section_at(16, 0, 0)->palette()[0], std::string("minecraft:stone"));
+			for (uint32_t i = 0; i < 20; i++)
+				space.set(i, 17, 3, "minecraft:air");
+			space.compact();
+			Assert::IsNull(space.section_at(0, 17, 3));
+			Assert::AreEqual(space.allocated_sections(), (size_t)1);
+
+			//与稠密空间互转，边缘区段不满
+			Schema::AbstractBlockSpace<uint16_t> dense(37, 18, 21);
+			for (unsigned short y = 0; y < 18; y++)
+				for (unsigned short z = 0; z < 21; z++)
+					for (unsigned short x = 0; x < 37; x++)
+						dense.at(x, y, z) = y < 16 ? 0 : static_cast<uint16_t>((x * 7 + z * 3) % 40);
+			SectionedBlockSpace<uint16_t> sectioned(dense);
+			Assert::AreEqual(sectioned.allocated_sections(), (size_t)6);
+			for (unsigned short y = 0; y < 18; y++)
+				for (unsigned short z = 0; z < 21; z++)
+					for (unsigned short x = 0; x < 37; x++)
+						Assert::AreEqual(sectioned.at(x, y, z), dense.at(x, y, z));
+			Assert::IsTrue(sectioned.to_dense().blocks() == dense.blocks());
+			Assert::ExpectException<NBT_Exception>([&] { huge.to_dense(); });
+		}
+
+		TEST_METHOD(Test_BlockLayout)
+		{
+			using Schema::AbstractBlockSpace;
+			AbstractBlockSpace<uint16_t> linear(19, 10, 13);
+			Assert::AreEqual(linear.index(3, 2, 5), (size_t)(3 + 5 * 19 + 2 * 19 * 13));
+			linear.for_each([](unsigned short x, unsigned short y, unsigned short z, uint16_t& v) {
+				v = static_cast<uint16_t>(x + y * 100 + z * 10000); });
+			Assert::AreEqual(linear(4, 6, 2), (uint16_t)20604);
+			//行与层视图
+			auto row = linear.row(6, 2);
+			Assert::AreEqual(row.size(), (size_t)19);
+			Assert::AreEqual(row[4], (uint16_t)20604);
+			auto slice = linear.slice(6);
+			Assert::AreEqual(slice.size(), (size_t)(19 * 13));
+			Assert::AreEqual(slice[2 * 19 + 4], (uint16_t)20604);
+			row[0] = 1;
+			Assert::AreEqual(linear.at(0, 6, 2), (uint16_t)1);
+			linear.at(0, 6, 2) = 20600;
+
+			//Z序分块：轴向补齐到8的倍数
+			using Morton = AbstractBlockSpace<uint16_t, std::vector<uint16_t>, Schema::morton_layout>;
+			Morton tiled(linear);
+			Assert::AreEqual(tiled.blocks().size(), (size_t)(24 * 16 * 16));
+			Assert::IsTrue(tiled.is_legal());
+			Assert::AreEqual(tiled.index(1, 0, 0), (size_t)1);
+			Assert::AreEqual(tiled.index(0, 0, 1), (size_t)2);
+			Assert::AreEqual(tiled.index(0, 1, 0), (size_t)4);
+			Assert::AreEqual(tiled.index(8, 0, 0), (size_t)512);
+			Assert::AreEqual(tiled.index(0, 0, 8), (size_t)(3 * 512));
+			std::unordered_set<size_t> seen;
+			size_t visited = 0;
+			tiled.for_each_position([&](unsigned short x, unsigned short y, unsigned short z, size_t i) {
+				Assert::AreEqual(i, tiled.index(x, y, z));
+				seen.insert(i);
+				visited++; });
+			Assert::AreEqual(visited, linear.volume());
+			Assert::AreEqual(seen.size(), linear.volume());
+			for (unsigned short y = 0; y < 10; y++)
+				for (unsigned short z = 0; z < 13; z++)
+					for (unsigned short x = 0; x < 19; x++)
+						Assert::AreEqual(tiled(x, y, z), linear(x, y, z));
+
+			//转回线性布局
+			AbstractBlockSpace<uint16_t> back(tiled);
+			Assert::IsTrue(back.blocks() == linear.blocks());
+		}
+
+		TEST_METHOD(Test_BlockRegion)
+		{
+			using namespace Schema;
+			//向量化内核与尾部
+			std::vector<uint16_t> raw(1003);
+			for (size_t i = 0; i < raw.size(); i++)
+				raw[i] = static_cast<uint16_t>(i % 5);
+			Assert::AreEqual(count_blocks(raw, 3), (size_t)200);
+			Assert::AreEqual(replace_blocks(std::span(raw).subspan(1), 3, 9), (size_t)200);
+			Assert::AreEqual(count_blocks(raw, 3), (size_t)0);
+			Assert::AreEqual(count_blocks(raw, 9), (size_t)200);
+			Assert::AreEqual(raw[1002], (uint16_t)2);
+
+			//多线程小分块，结果与逐个计算一致
+			RegionOptions options{ 4, 100 };
+			AbstractBlockSpace<uint16_t> space(70, 40, 50);
+			BlockBox box{ 5, 3, 7, 66, 38, 49 };
+			fill(space, box, 2, options);
+			Assert::AreEqual(count(space, BlockBox::of(space), 2, options), box.volume());
+			Assert::AreEqual(space.at(4, 3, 7), (uint16_t)0);
+			Assert::AreEqual(space.at(65, 37, 48), (uint16_t)2);
+			Assert::AreEqual(space.at(66, 37, 48), (uint16_t)0);
+
+			BlockBox inner{ 10, 10, 10, 20, 20, 20 };
+			Assert::AreEqual(replace(space, inner, 2, 5, options), (size_t)1000);
+			Assert::AreEqual(replace(space, BlockBox::of(space), 5, 6), (size_t)1000);
+			size_t set = replace_if(space, BlockBox::of(space), [](uint16_t v) { return v != 0 && v != 6; }, 1, options);
+			Assert::AreEqual(set, box.volume() - 1000);
+			Assert::AreEqual(count_if(space, box, [](uint16_t v) { return v == 1; }, options), box.volume() - 1000);
+			Assert::AreEqual(count(space, inner, 6), (size_t)1000);
+			Assert::ExpectException<NBT_Exception>([&] { fill(space, BlockBox{ 0, 0, 0, 71, 1, 1 }, 1); });
+
+			//Z序分块与位压缩存储走逐个路径
+			AbstractBlockSpace<uint16_t, std::vector<uint16_t>, morton_layout> tiled(space);
+			Assert::AreEqual(replace(tiled, inner, 6, 7, options), (size_t)1000);
+			Assert::AreEqual(count(tiled, BlockBox::of(tiled), 7, options), (size_t)1000);
+			AbstractBlockSpace<uint16_t, PackedBlockStorage> packed(PackedBlockStorage(space.blocks()), 70, 40, 50);
+			Assert::AreEqual(replace(packed, inner, 6, 300, options), (size_t)1000);
+			Assert::AreEqual(packed.blocks().bits(), 9u);
+			Assert::AreEqual(count(packed, box, 1, options), box.volume() - 1000);
+			fill(packed, inner, 0);
+			Assert::AreEqual((uint16_t)packed.at(15, 15, 15), (uint16_t)0);
+		}
+
 	};
 }